@@ -0,0 +1,4 @@
+Prints a greeting
+Mostly measures startup and compilation latency
+
+++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.
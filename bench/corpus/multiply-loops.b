@@ -0,0 +1,6 @@
+Three nested counters of 255 iterations each; the innermost one spreads a
+value over three cells and gathers it back
+Every loop in the body is a transfer loop so this measures multiply loops
+
+-[>-[>-[>+++++[>+>++>+++<<<-]>[-<+>]>[-]>[-]<<<<-]<-]<-]
+++++++++[>++++++++<-]>+.
@@ -0,0 +1,8 @@
+Deeply nested counting loops with hardly any memory traffic: seven levels of
+ten iterations each around a loop clearing the innermost cell
+Measures how well plain loops and the current cell are compiled
+
+++++++++[>++++++++<-]>.[-]<
+++++++++++[>++++++++++[>++++++++++[>++++++++++[>++++++++++[>++++++++++[>++
+++++++++[>++++++++++[-]<-]<-]<-]<-]<-]<-]<-]
+++++++++++.
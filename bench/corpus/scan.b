@@ -0,0 +1,7 @@
+Fills 255 cells with non zero values between two zero cells and walks them
+end to end 65025 times looking for the zero cell at either side
+Measures scan loops
+
+>-[[->+>+<<]>>[-<<+>>]<-]
+>>-[>-[<<<<[<]>[>]>>>-]<-]
+>++++++++[<++++++++>-]<+.
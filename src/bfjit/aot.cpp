@@ -0,0 +1,455 @@
+#include "aot.hpp"
+#include "cell.hpp"
+#include "exception.hpp"
+#include "x64_compiler.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+#include <elf.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace bfjit;
+
+namespace
+{
+constexpr inline auto MainFuncName = "bfjit_main";
+
+// Built with `BFJIT_TAPE_SIZE` and `BFJIT_CELL_BYTES` defined. The buffers behave like `FileOutputBuffer` and a
+// `FileInputBuffer` tied to it, and the scan kernels like the scalar ones of the JIT, which is all the code ever calls
+// into.
+constexpr inline auto RuntimeSource = R"(#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum
+{
+    Success,
+    WriteError,
+    ReadError,
+    MemoryUnderrun,
+    OutOfMemory,
+};
+
+typedef struct OutputBuffer
+{
+    char *Cursor;
+    char *Limit;
+    uint32_t (*Flush)(struct OutputBuffer *);
+} OutputBuffer;
+
+typedef struct InputBuffer
+{
+    char *Cursor;
+    char *Limit;
+    uint32_t (*Refill)(struct InputBuffer *);
+} InputBuffer;
+
+uint32_t bfjit_main(char *begin, char *end, OutputBuffer *output, InputBuffer *input);
+
+static char outputStorage[1 << 16];
+static char inputStorage[1 << 16];
+
+static uint32_t FlushOutput(OutputBuffer *output)
+{
+    char *first = outputStorage;
+    while (first != output->Cursor)
+    {
+        const ssize_t written = write(STDOUT_FILENO, first, output->Cursor - first);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            output->Cursor = outputStorage;
+            return WriteError;
+        }
+
+        first += written;
+    }
+
+    output->Cursor = outputStorage;
+    return Success;
+}
+
+static OutputBuffer output = {outputStorage, outputStorage + sizeof(outputStorage), FlushOutput};
+
+static uint32_t RefillInput(InputBuffer *input)
+{
+    const uint32_t flushResult = FlushOutput(&output);
+    if (flushResult != Success)
+    {
+        return flushResult;
+    }
+
+    while (1)
+    {
+        const ssize_t count = read(STDIN_FILENO, inputStorage, sizeof(inputStorage));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return ReadError;
+        }
+
+        input->Cursor = inputStorage;
+        input->Limit = inputStorage + count;
+        return Success;
+    }
+}
+
+uint32_t bfjit_write_output(OutputBuffer *output, const char *data, uint64_t size)
+{
+    while (size)
+    {
+        if (output->Cursor == output->Limit)
+        {
+            const uint32_t result = output->Flush(output);
+            if (result != Success)
+            {
+                return result;
+            }
+        }
+
+        const uint64_t room = (uint64_t)(output->Limit - output->Cursor);
+        const uint64_t count = size < room ? size : room;
+        memcpy(output->Cursor, data, count);
+        output->Cursor += count;
+        data += count;
+        size -= count;
+    }
+
+    return Success;
+}
+
+#define BFJIT_SCAN_KERNELS(bits)                                                                                       \
+    char *bfjit_scan_forward_##bits(char *current, char *end, int64_t stride)                                          \
+    {                                                                                                                  \
+        const int64_t step = stride * (bits / 8);                                                                      \
+        for (int64_t index = 0; index < end - current; index += step)                                                  \
+        {                                                                                                              \
+            if (*(const uint##bits##_t *)(current + index) == 0)                                                       \
+            {                                                                                                          \
+                return current + index;                                                                                \
+            }                                                                                                          \
+        }                                                                                                              \
+                                                                                                                       \
+        return NULL;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    char *bfjit_scan_backward_##bits(char *current, char *begin, int64_t stride)                                       \
+    {                                                                                                                  \
+        const int64_t step = stride * (bits / 8);                                                                      \
+        for (int64_t index = 0; index <= current - begin; index += step)                                               \
+        {                                                                                                              \
+            if (*(const uint##bits##_t *)(current - index) == 0)                                                       \
+            {                                                                                                          \
+                return current - index;                                                                                \
+            }                                                                                                          \
+        }                                                                                                              \
+                                                                                                                       \
+        return NULL;                                                                                                   \
+    }
+
+BFJIT_SCAN_KERNELS(8)
+BFJIT_SCAN_KERNELS(16)
+BFJIT_SCAN_KERNELS(32)
+BFJIT_SCAN_KERNELS(64)
+
+int main(void)
+{
+    const uint64_t size = BFJIT_TAPE_SIZE / BFJIT_CELL_BYTES * BFJIT_CELL_BYTES;
+    char *tape = calloc(size ? size : 1, 1);
+    if (!tape)
+    {
+        fputs("failed to allocate the tape\n", stderr);
+        return OutOfMemory;
+    }
+
+    InputBuffer input = {inputStorage, inputStorage, RefillInput};
+    const uint32_t result = bfjit_main(tape, tape + size, &output, &input);
+    const uint32_t flushResult = FlushOutput(&output);
+    free(tape);
+
+    return result == Success ? (int)flushResult : (int)result;
+}
+)";
+
+// Tells apart the temporary files of programs emitted at once.
+std::atomic<UInt64> TemporaryFileCounter = 0;
+
+class StringTable
+{
+public:
+    UInt32 Add(StringRef text)
+    {
+        const auto offset = static_cast<UInt32>(m_data.size());
+        m_data.insert(m_data.end(), text.begin(), text.end());
+        m_data.push_back('\0');
+        return offset;
+    }
+
+    const Vector<CharType> &Data() const noexcept
+    {
+        return m_data;
+    }
+
+private:
+    Vector<CharType> m_data{'\0'};
+};
+
+enum Section : UInt32
+{
+    NullSection,
+    TextSection,
+    DataSection,
+    RelocationSection,
+    SymbolSection,
+    StringSection,
+    SectionNameSection,
+    StackNoteSection,
+    SectionCount,
+};
+
+// Lays out a relocatable object holding the code in `.text` and its data in `.rodata`. The code is exported as
+// `bfjit_main`, and the functions it calls are left undefined for the linker to find in the runtime.
+Vector<CharType> WriteObject(const RelocatableCode &code)
+{
+    StringTable strings;
+    Vector<Elf64_Sym> symbols(1);
+    symbols.push_back(Elf64_Sym{.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION), .st_shndx = DataSection});
+    const auto dataSymbol = static_cast<UInt32>(symbols.size() - 1);
+    const auto firstGlobalSymbol = static_cast<UInt32>(symbols.size());
+    symbols.push_back(Elf64_Sym{
+        .st_name = strings.Add(MainFuncName),
+        .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC),
+        .st_shndx = TextSection,
+        .st_size = code.Code.size(),
+    });
+
+    std::unordered_map<String, UInt32> functionSymbols;
+    Vector<Elf64_Rela> relocations;
+    for (const auto &relocation : code.Relocations)
+    {
+        auto symbol = dataSymbol;
+        if (!relocation.Symbol.empty())
+        {
+            const auto [entry, isNew] =
+                functionSymbols.emplace(relocation.Symbol, static_cast<UInt32>(symbols.size()));
+            if (isNew)
+            {
+                symbols.push_back(Elf64_Sym{
+                    .st_name = strings.Add(relocation.Symbol),
+                    .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+                    .st_shndx = SHN_UNDEF,
+                });
+            }
+            symbol = entry->second;
+        }
+
+        relocations.push_back(Elf64_Rela{
+            .r_offset = relocation.Offset,
+            .r_info = ELF64_R_INFO(symbol, relocation.Type),
+            .r_addend = relocation.Addend,
+        });
+    }
+
+    StringTable sectionNames;
+    Vector<Elf64_Shdr> sections(SectionCount);
+    Vector<CharType> object(sizeof(Elf64_Ehdr));
+    const auto appendSection = [&](Section index, const char *name, UInt32 type, UInt64 flags, const void *data,
+                                   std::size_t size, UInt64 alignment) {
+        object.resize((object.size() + alignment - 1) / alignment * alignment);
+        sections[index] = Elf64_Shdr{
+            .sh_name = sectionNames.Add(name),
+            .sh_type = type,
+            .sh_flags = flags,
+            .sh_offset = object.size(),
+            .sh_size = size,
+            .sh_addralign = alignment,
+        };
+        object.insert(object.end(), static_cast<const CharType *>(data), static_cast<const CharType *>(data) + size);
+    };
+
+    appendSection(TextSection, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, code.Code.data(), code.Code.size(),
+                  16);
+    appendSection(DataSection, ".rodata", SHT_PROGBITS, SHF_ALLOC, code.Data.data(), code.Data.size(), 1);
+    appendSection(RelocationSection, ".rela.text", SHT_RELA, SHF_INFO_LINK, relocations.data(),
+                  relocations.size() * sizeof(Elf64_Rela), 8);
+    sections[RelocationSection].sh_link = SymbolSection;
+    sections[RelocationSection].sh_info = TextSection;
+    sections[RelocationSection].sh_entsize = sizeof(Elf64_Rela);
+    appendSection(SymbolSection, ".symtab", SHT_SYMTAB, 0, symbols.data(), symbols.size() * sizeof(Elf64_Sym), 8);
+    sections[SymbolSection].sh_link = StringSection;
+    sections[SymbolSection].sh_info = firstGlobalSymbol;
+    sections[SymbolSection].sh_entsize = sizeof(Elf64_Sym);
+    appendSection(StringSection, ".strtab", SHT_STRTAB, 0, strings.Data().data(), strings.Data().size(), 1);
+    // Keeps the linker from making the stack executable.
+    appendSection(StackNoteSection, ".note.GNU-stack", SHT_PROGBITS, 0, nullptr, 0, 1);
+    // Names its own section, so it has to come last.
+    sections[SectionNameSection].sh_name = sectionNames.Add(".shstrtab");
+    sections[SectionNameSection].sh_type = SHT_STRTAB;
+    sections[SectionNameSection].sh_offset = object.size();
+    sections[SectionNameSection].sh_size = sectionNames.Data().size();
+    sections[SectionNameSection].sh_addralign = 1;
+    object.insert(object.end(), sectionNames.Data().begin(), sectionNames.Data().end());
+
+    object.resize((object.size() + 7) / 8 * 8);
+    Elf64_Ehdr header = {
+        .e_type = ET_REL,
+        .e_machine = EM_X86_64,
+        .e_version = EV_CURRENT,
+        .e_shoff = object.size(),
+        .e_ehsize = sizeof(Elf64_Ehdr),
+        .e_shentsize = sizeof(Elf64_Shdr),
+        .e_shnum = SectionCount,
+        .e_shstrndx = SectionNameSection,
+    };
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    std::memcpy(object.data(), &header, sizeof(header));
+
+    const auto sectionHeaders = reinterpret_cast<const CharType *>(sections.data());
+    object.insert(object.end(), sectionHeaders, sectionHeaders + sections.size() * sizeof(Elf64_Shdr));
+    return object;
+}
+
+// Holds one of the inputs of the C compiler, removing it once the program has been built or has failed to.
+class TemporaryFile
+{
+public:
+    TemporaryFile(StringRef extension, const void *data, std::size_t size)
+        : m_path(fmt::format("{}/bfjit.{}.{}{}", std::filesystem::temp_directory_path().string(), getpid(),
+                             TemporaryFileCounter++, extension))
+    {
+        const auto file = std::fopen(m_path.c_str(), "wb");
+        if (!file)
+        {
+            throw Exception::Formatted("failed to create {}: {}", m_path, std::strerror(errno));
+        }
+
+        const auto isWritten = std::fwrite(data, 1, size, file) == size;
+        if (std::fclose(file) != 0 || !isWritten)
+        {
+            std::remove(m_path.c_str());
+            throw Exception::Formatted("failed to write {}", m_path);
+        }
+    }
+
+    TemporaryFile(const TemporaryFile &) = delete;
+
+    TemporaryFile &operator=(const TemporaryFile &) = delete;
+
+    ~TemporaryFile()
+    {
+        std::remove(m_path.c_str());
+    }
+
+    const String &Path() const noexcept
+    {
+        return m_path;
+    }
+
+private:
+    String m_path;
+};
+
+void RunCompiler(const Vector<String> &arguments)
+{
+    assert(!arguments.empty());
+
+    Vector<char *> argv;
+    for (const auto &argument : arguments)
+    {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+    if (const auto error = posix_spawnp(&pid, argv.front(), nullptr, nullptr, argv.data(), environ))
+    {
+        throw Exception::Formatted("failed to run {}: {}", arguments.front(), std::strerror(error));
+    }
+
+    auto status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw Exception::Formatted("failed to wait for {}: {}", arguments.front(), std::strerror(errno));
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        throw Exception::Formatted("{} failed to build the program", arguments.front());
+    }
+}
+} // namespace
+
+EmitKind bfjit::ParseEmitKind(StringRef name)
+{
+    if (name == "obj")
+    {
+        return EmitKind::Object;
+    }
+
+    if (name == "exe")
+    {
+        return EmitKind::Executable;
+    }
+
+    throw Exception::Formatted("unknown output kind {}, expected `obj` or `exe`", name);
+}
+
+void bfjit::EmitProgram(const CompilerContext &context, const EmitOptions &options)
+{
+    if (!X64Compiler::IsSupported())
+    {
+        throw Exception("programs can only be emitted on x86-64 Linux");
+    }
+
+    if (options.OutputPath.empty())
+    {
+        throw Exception("output path must not be empty");
+    }
+
+    auto unguardedContext = context;
+    unguardedContext.GuardSize = 0;
+    const auto object = WriteObject(X64Compiler::CompileRelocatable(unguardedContext));
+    const auto cellBytes = DispatchCellBits(context.CellBits, [](auto cell) { return decltype(cell)::Bytes; });
+
+    const TemporaryFile objectFile(".o", object.data(), object.size());
+    const TemporaryFile runtimeFile(".c", RuntimeSource, std::strlen(RuntimeSource));
+    Vector<String> arguments = {
+        options.Compiler,
+        "-O2",
+        fmt::format("-DBFJIT_TAPE_SIZE={}ULL", options.TapeSize),
+        fmt::format("-DBFJIT_CELL_BYTES={}", cellBytes),
+    };
+    // A relocatable link merges the runtime into the object without pulling in the C library.
+    if (options.Kind == EmitKind::Object)
+    {
+        arguments.insert(arguments.end(), {"-r", "-nostdlib"});
+    }
+    arguments.insert(arguments.end(), {"-o", options.OutputPath, runtimeFile.Path(), objectFile.Path()});
+    RunCompiler(arguments);
+}
@@ -0,0 +1,33 @@
+#ifndef BFJIT_AOT_HPP
+#define BFJIT_AOT_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+enum class EmitKind
+{
+    Object,
+    Executable,
+};
+
+// Parses `obj` or `exe`.
+EmitKind ParseEmitKind(StringRef name);
+
+// The emitted program runs on a zeroed tape of `TapeSize` bytes, reading stdin and writing stdout, and exits with
+// its `Result` code. Objects define `main` and only need the C library to be linked into an executable. The runtime
+// is built and linked by the C compiler named by `Compiler`.
+struct EmitOptions
+{
+    EmitKind Kind = EmitKind::Executable;
+    String OutputPath;
+    UInt64 TapeSize = 1 << 20;
+    String Compiler = "cc";
+};
+
+// Compiles the program ahead of time with the x64 backend into an x86-64 Linux ELF file at `options.OutputPath`.
+// The tape has no guard regions, so the guard size of `context` is ignored and every access is checked.
+void EmitProgram(const CompilerContext &context, const EmitOptions &options);
+} // namespace bfjit
+
+#endif // BFJIT_AOT_HPP
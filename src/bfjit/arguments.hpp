@@ -53,6 +53,14 @@ void ParseArguments(Iterator first, Iterator last, std::tuple<States...> &states
     auto ParseOption = [&](const StringRef &currentArgument, auto &state) -> bool {
         if (!state.IsProcessed && !state.Argument.Name.empty() && state.Argument.Name == currentArgument)
         {
+            if (state.Argument.ImplicitValue)
+            {
+                state.IsProcessed = true;
+                state.Argument.Value = state.Argument.Parser(*state.Argument.ImplicitValue);
+
+                return true;
+            }
+
             if (first == last)
             {
                 throw Exception::Formatted("missing command line argument value `{}`", state.Argument.Name);
@@ -113,6 +121,24 @@ template <> struct DefaultParser<String>
     }
 };
 
+template <> struct DefaultParser<Boolean>
+{
+    Boolean operator()(const StringRef &value) const
+    {
+        if (value == "true")
+        {
+            return true;
+        }
+
+        if (value == "false")
+        {
+            return false;
+        }
+
+        throw Exception::Formatted("failed to parse `{}` to boolean", value);
+    }
+};
+
 template <> struct DefaultParser<UInt32>
 {
     UInt32 operator()(const StringRef &value) const
@@ -129,6 +155,22 @@ template <> struct DefaultParser<UInt32>
     }
 };
 
+template <> struct DefaultParser<UInt64>
+{
+    UInt64 operator()(const StringRef &value) const
+    {
+        UInt64 result = 0;
+        const auto first = value.data();
+        const auto last = first + value.size();
+        if (std::from_chars(first, last, result).ec != std::errc())
+        {
+            throw Exception::Formatted("failed to parse `{}` to uint64", value);
+        }
+
+        return result;
+    }
+};
+
 template <typename Type, typename Parser_ = DefaultParser<Type>> struct Argument
 {
     using ValueType = Type;
@@ -138,6 +180,7 @@ template <typename Type, typename Parser_ = DefaultParser<Type>> struct Argument
     StringRef Name;
     Optional<StringRef> Description;
     Optional<StringRef> DefaultValue;
+    Optional<StringRef> ImplicitValue;
     Boolean IsRequired = false;
     ValueType &Value;
     ParserType Parser;
@@ -168,6 +211,14 @@ template <typename Type, typename Parser_ = DefaultParser<Type>> struct Argument
         DefaultValue = value;
         return *this;
     }
+
+    // Makes the option a switch which takes no value on the command line.
+    SelfType &Flag() noexcept
+    {
+        ImplicitValue = "true";
+        DefaultValue = "false";
+        return *this;
+    }
 };
 
 template <typename Iterator, typename... Arguments>
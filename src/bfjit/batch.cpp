@@ -0,0 +1,190 @@
+#include "batch.hpp"
+#include "exception.hpp"
+#include "instruction.hpp"
+#include "io.hpp"
+#include "lexer.hpp"
+#include "program.hpp"
+#include "statistics.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace bfjit;
+
+namespace
+{
+class FileDescriptor
+{
+public:
+    FileDescriptor(const char *path, int flags) : m_fd(open(path, flags | O_CLOEXEC, 0644))
+    {
+        if (m_fd < 0)
+        {
+            throw Exception::Formatted("failed to open {}: {}", path, std::strerror(errno));
+        }
+    }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    ~FileDescriptor()
+    {
+        close(m_fd);
+    }
+
+    int Get() const noexcept
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+};
+
+struct Worker
+{
+    std::unique_ptr<CompilerBackend> Backend;
+    std::unique_ptr<bfjit::Tape> Tape;
+    Boolean IsTapeUsed = false;
+};
+
+Optional<String> ParseManifestPath(StringRef field)
+{
+    return field == "-" ? std::nullopt : Optional<String>(String(field));
+}
+
+Vector<StringRef> SplitFields(StringRef line)
+{
+    Vector<StringRef> fields;
+    std::size_t position = 0;
+    while (true)
+    {
+        const auto first = line.find_first_not_of(" \t\r", position);
+        if (first == StringRef::npos)
+        {
+            return fields;
+        }
+
+        const auto last = std::min(line.find_first_of(" \t\r", first), line.size());
+        fields.push_back(line.substr(first, last - first));
+        position = last;
+    }
+}
+
+// The devices stand in for missing files: reading /dev/null ends the input at once, and writing to it discards the
+// output.
+BatchJobResult RunJob(const BatchJob &job, Worker &worker, const BatchOptions &options)
+{
+    BatchJobResult result;
+
+    const Stopwatch compileStopwatch;
+    const SourceFile source(job.Program);
+    const auto instructions = LexInstructions(source.Text());
+    SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+    const CompiledProgram program(*worker.Backend, CompilerContext{
+                                                       .Reader = &reader,
+                                                       .GuardSize = worker.Tape->GuardSize(),
+                                                       .CellBits = options.CellBits,
+                                                       .PrefixSteps = options.PrefixSteps,
+                                                   });
+    result.CompileSeconds = compileStopwatch.ElapsedSeconds();
+
+    const FileDescriptor inputFile(job.Input ? job.Input->c_str() : "/dev/null", O_RDONLY);
+    const FileDescriptor outputFile(job.Output ? job.Output->c_str() : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC);
+    FileOutputBuffer output(outputFile.Get());
+    FileInputBuffer input(inputFile.Get(), &output);
+
+    if (worker.IsTapeUsed)
+    {
+        worker.Tape->Clear();
+    }
+    worker.IsTapeUsed = true;
+
+    const Stopwatch executeStopwatch;
+    const auto status = program.Run(*worker.Tape, output, input);
+    const auto flushStatus = output.FlushAll();
+    result.ExecuteSeconds = executeStopwatch.ElapsedSeconds();
+    result.Status = status == Result::Success ? flushStatus : status;
+
+    return result;
+}
+} // namespace
+
+Vector<BatchJob> bfjit::ReadBatchManifest(const String &fileName)
+{
+    const SourceFile manifest(fileName);
+    const auto text = manifest.Text();
+
+    Vector<BatchJob> jobs;
+    std::size_t lineNumber = 0;
+    std::size_t position = 0;
+    while (position < text.size())
+    {
+        const auto lineEnd = std::min(text.find('\n', position), text.size());
+        const auto fields = SplitFields(text.substr(position, lineEnd - position));
+        position = lineEnd + 1;
+        ++lineNumber;
+
+        if (fields.empty() || fields.front().starts_with('#'))
+        {
+            continue;
+        }
+
+        if (fields.size() > 3 || fields.front() == "-")
+        {
+            throw Exception::Formatted("invalid job at {}:{}", fileName, lineNumber);
+        }
+
+        jobs.push_back(BatchJob{
+            .Program = String(fields[0]),
+            .Input = fields.size() > 1 ? ParseManifestPath(fields[1]) : std::nullopt,
+            .Output = fields.size() > 2 ? ParseManifestPath(fields[2]) : std::nullopt,
+        });
+    }
+
+    return jobs;
+}
+
+Vector<BatchJobResult> bfjit::RunBatch(const Vector<BatchJob> &jobs, const BatchOptions &options)
+{
+    if (!options.Workers)
+    {
+        throw Exception("the number of workers must be positive");
+    }
+
+    if (!options.CreateBackend)
+    {
+        throw Exception("backend factory must not be null");
+    }
+
+    // Backends and tapes are created by the workers themselves, and only once they get a job.
+    Vector<BatchJobResult> results(jobs.size());
+    Vector<Worker> workers(options.Workers);
+    RunWorkStealing(jobs.size(), options.Workers, [&](UInt32 workerIndex, std::size_t jobIndex) {
+        auto &worker = workers[workerIndex];
+        auto &result = results[jobIndex];
+        try
+        {
+            if (!worker.Backend)
+            {
+                worker.Backend = options.CreateBackend();
+                worker.Tape = std::make_unique<bfjit::Tape>(options.Tape);
+            }
+
+            result = RunJob(jobs[jobIndex], worker, options);
+        }
+        catch (const std::exception &ex)
+        {
+            result.Error = String(ex.what());
+        }
+    });
+
+    return results;
+}
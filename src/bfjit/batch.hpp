@@ -0,0 +1,51 @@
+#ifndef BFJIT_BATCH_HPP
+#define BFJIT_BATCH_HPP
+
+#include "tape.hpp"
+#include "types.hpp"
+
+#include <functional>
+#include <memory>
+
+namespace bfjit
+{
+// A program to run along with the files its input is read from and its output is written to. Jobs without an input
+// read an empty one, and the output of jobs without an output file is discarded.
+struct BatchJob
+{
+    String Program;
+    Optional<String> Input;
+    Optional<String> Output;
+};
+
+// `CompileSeconds` covers reading and lexing the program as well. `Error` describes why a job couldn't be run, in which
+// case `Status` is meaningless.
+struct BatchJobResult
+{
+    Result Status = Result::Success;
+    double CompileSeconds = 0;
+    double ExecuteSeconds = 0;
+    Optional<String> Error;
+};
+
+// Every worker compiles with a backend made by `CreateBackend` and runs programs on a tape of its own, both of which
+// are reused by the jobs it runs. Programs are compiled for cells `CellBits` wide, evaluating up to `PrefixSteps` steps
+// of them at compile time.
+struct BatchOptions
+{
+    UInt32 Workers = 1;
+    TapeOptions Tape;
+    UInt32 CellBits = 8;
+    UInt64 PrefixSteps = 0;
+    std::function<std::unique_ptr<CompilerBackend>()> CreateBackend;
+};
+
+// Reads a manifest listing one job per line as `<program> [<input> [<output>]]`, where `-` stands for a missing file.
+// Blank lines and lines starting with `#` are skipped.
+Vector<BatchJob> ReadBatchManifest(const String &fileName);
+
+// Runs the jobs on a work-stealing thread pool, returning their results in the same order.
+Vector<BatchJobResult> RunBatch(const Vector<BatchJob> &jobs, const BatchOptions &options);
+} // namespace bfjit
+
+#endif // BFJIT_BATCH_HPP
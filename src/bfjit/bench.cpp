@@ -0,0 +1,383 @@
+#include "arguments.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include "lexer.hpp"
+#include "mir_compiler.hpp"
+#include "program.hpp"
+#include "tape.hpp"
+#include "x64_compiler.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <optional>
+
+#ifndef BFJIT_BENCH_CORPUS
+#define BFJIT_BENCH_CORPUS "bench/corpus"
+#endif
+
+using namespace bfjit;
+
+namespace
+{
+struct Arguments
+{
+    String CorpusDirectory;
+    String Backend;
+    UInt32 Repetitions = 3;
+    UInt64 HeapSize = 1 << 20;
+    UInt32 CellBits = 8;
+    Boolean Json = false;
+};
+
+template <typename Iterator> Arguments ParseArguments(Iterator first, Iterator last)
+{
+    Arguments args;
+    cli::ParseArguments(first, last,
+                        cli::Argument(args.CorpusDirectory)
+                            .WithName("--corpus")
+                            .WithDescription("The directory holding `.b` programs, with their input in `.in` files")
+                            .WithDefaultValue(BFJIT_BENCH_CORPUS),
+                        cli::Argument(args.Backend)
+                            .WithName("--backend")
+                            .WithDescription("The backend to measure: `mir`, `tiered`, `x64`, `interp` or `all`")
+                            .WithDefaultValue("all"),
+                        cli::Argument(args.Repetitions)
+                            .WithName("--repeat")
+                            .WithDescription("The number of runs of every workload, the fastest of which is reported")
+                            .WithDefaultValue("3"),
+                        cli::Argument(args.HeapSize)
+                            .WithName("--heap-size")
+                            .WithDescription("The size of heap, in bytes, available to the programs")
+                            .WithDefaultValue("1048576"),
+                        cli::Argument(args.CellBits)
+                            .WithName("--cell-bits")
+                            .WithDescription("The width of cells in bits: 8, 16, 32 or 64")
+                            .WithDefaultValue("8"),
+                        cli::Argument(args.Json)
+                            .WithName("--json")
+                            .WithDescription("Print the results as JSON")
+                            .Flag());
+
+    return args;
+}
+
+struct Workload
+{
+    String Name;
+    String Source;
+    Vector<CharType> Input;
+};
+
+struct Measurement
+{
+    String Workload;
+    String Backend;
+    std::size_t SourceBytes = 0;
+    std::size_t Instructions = 0;
+    double LexSeconds = std::numeric_limits<double>::infinity();
+    double CompileSeconds = std::numeric_limits<double>::infinity();
+    double ExecuteSeconds = std::numeric_limits<double>::infinity();
+    UInt64 OutputBytes = 0;
+    UInt64 InputBytes = 0;
+    Result Status = Result::Success;
+};
+
+// Discards the output, only counting it, so that the terminal doesn't dominate the execution time.
+class CountingOutputBuffer final : public OutputBuffer
+{
+public:
+    CountingOutputBuffer() : OutputBuffer{}, m_storage(1 << 16)
+    {
+        Cursor = m_storage.data();
+        Limit = m_storage.data() + m_storage.size();
+        Flush = FlushBuffer;
+    }
+
+    UInt64 Total() const noexcept
+    {
+        return m_total + static_cast<UInt64>(Cursor - m_storage.data());
+    }
+
+private:
+    static Result FlushBuffer(OutputBuffer *buffer)
+    {
+        const auto self = static_cast<CountingOutputBuffer *>(buffer);
+        self->m_total += static_cast<UInt64>(self->Cursor - self->m_storage.data());
+        self->Cursor = self->m_storage.data();
+        return Result::Success;
+    }
+
+    Vector<CharType> m_storage;
+    UInt64 m_total = 0;
+};
+
+String Repeat(StringRef text, std::size_t count)
+{
+    String result;
+    result.reserve(text.size() * count);
+    for (std::size_t index = 0; index < count; ++index)
+    {
+        result.append(text);
+    }
+
+    return result;
+}
+
+// Workloads too large to be worth bundling as files.
+Vector<Workload> GenerateWorkloads()
+{
+    Vector<Workload> workloads;
+
+    // Around 10 MB of source, most of it comments, running each block once.
+    workloads.push_back(Workload{
+        .Name = "generated-large",
+        .Source = Repeat("Generated block which moves some values around and clears them again\n"
+                         "++++[>++++++<-]>[<+>-]<[-]>>+++[<<+>>-]<<[>+<-]>[-]<\n",
+                         100000),
+    });
+
+    // Prints 255 cubed characters.
+    workloads.push_back(Workload{
+        .Name = "long-output",
+        .Source = "++++++++[>++++++++<-]>+>-[>-[>-[<<<.>>>-]<-]<-]",
+    });
+
+    // Echoes 16 MB of input up to the terminating zero.
+    Vector<CharType> input(16 << 20, 'x');
+    input.back() = 0;
+    workloads.push_back(Workload{
+        .Name = "long-input",
+        .Source = ",[.,]",
+        .Input = std::move(input),
+    });
+
+    return workloads;
+}
+
+String ReadFile(const std::filesystem::path &path)
+{
+    const SourceFile file(path.string());
+    return String(file.Text());
+}
+
+Vector<Workload> LoadWorkloads(const String &directory)
+{
+    Vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".b")
+        {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    Vector<Workload> workloads;
+    for (const auto &path : paths)
+    {
+        auto workload = Workload{
+            .Name = path.stem().string(),
+            .Source = ReadFile(path),
+        };
+
+        auto inputPath = path;
+        inputPath.replace_extension(".in");
+        if (std::filesystem::exists(inputPath))
+        {
+            const auto input = ReadFile(inputPath);
+            workload.Input.assign(input.begin(), input.end());
+        }
+
+        workloads.push_back(std::move(workload));
+    }
+
+    return workloads;
+}
+
+std::unique_ptr<CompilerBackend> CreateBackend(StringRef name)
+{
+    if (name == "mir")
+    {
+        return std::make_unique<MirCompiler>();
+    }
+
+    if (name == "tiered")
+    {
+        return std::make_unique<MirCompiler>(MirCompilerOptions{.Tiered = true});
+    }
+
+    if (name == "interp")
+    {
+        return std::make_unique<Interpreter>();
+    }
+
+    if (name == "x64")
+    {
+        return std::make_unique<X64Compiler>();
+    }
+
+    throw Exception::Formatted("unknown backend {}", name);
+}
+
+template <typename Function> double MeasureSeconds(Function &&function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto finish = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+Measurement Measure(const Workload &workload, const String &backendName, const Arguments &arguments)
+{
+    auto measurement = Measurement{
+        .Workload = workload.Name,
+        .Backend = backendName,
+        .SourceBytes = workload.Source.size(),
+    };
+
+    for (UInt32 repetition = 0; repetition < arguments.Repetitions; ++repetition)
+    {
+        Vector<Instruction> instructions;
+        const auto lexSeconds = MeasureSeconds([&] { instructions = LexInstructions(workload.Source); });
+
+        // Every run gets a backend of its own, so that nothing compiled earlier is reused.
+        const auto backend = CreateBackend(backendName);
+        SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+        Optional<CompiledProgram> program;
+        const auto compileSeconds = MeasureSeconds([&] {
+            program.emplace(*backend, CompilerContext{.Reader = &reader, .CellBits = arguments.CellBits});
+        });
+
+        Tape tape(TapeOptions{.Size = arguments.HeapSize});
+        auto input = workload.Input;
+        CountingOutputBuffer outputBuffer;
+        auto inputBuffer = InputBuffer{
+            .Cursor = input.data(),
+            .Limit = input.data() + input.size(),
+            .Refill = [](InputBuffer *) { return Result::ReadError; },
+        };
+        const auto executeSeconds = MeasureSeconds([&] {
+            measurement.Status = program->Run(tape, outputBuffer, inputBuffer);
+        });
+
+        measurement.Instructions = instructions.size();
+        measurement.LexSeconds = std::min(measurement.LexSeconds, lexSeconds);
+        measurement.CompileSeconds = std::min(measurement.CompileSeconds, compileSeconds);
+        measurement.ExecuteSeconds = std::min(measurement.ExecuteSeconds, executeSeconds);
+        measurement.OutputBytes = outputBuffer.Total();
+        measurement.InputBytes = static_cast<UInt64>(inputBuffer.Cursor - input.data());
+    }
+
+    return measurement;
+}
+
+double MegabytesPerSecond(UInt64 bytes, double seconds)
+{
+    return seconds > 0 ? static_cast<double>(bytes) / seconds / (1 << 20) : 0;
+}
+
+void PrintTable(const Vector<Measurement> &measurements)
+{
+    fmt::print("{:<20} {:<8} {:>12} {:>10} {:>10} {:>12} {:>12} {:>12} {:>10}  {}\n", "workload", "backend", "source",
+               "lex ms", "lex MB/s", "compile ms", "execute ms", "io MB/s", "total ms", "status");
+    for (const auto &measurement : measurements)
+    {
+        const auto totalSeconds = measurement.LexSeconds + measurement.CompileSeconds + measurement.ExecuteSeconds;
+        fmt::print("{:<20} {:<8} {:>12} {:>10.3f} {:>10.1f} {:>12.3f} {:>12.3f} {:>12.1f} {:>10.3f}  {}\n",
+                   measurement.Workload, measurement.Backend, measurement.SourceBytes, measurement.LexSeconds * 1000,
+                   MegabytesPerSecond(measurement.SourceBytes, measurement.LexSeconds),
+                   measurement.CompileSeconds * 1000, measurement.ExecuteSeconds * 1000,
+                   MegabytesPerSecond(measurement.OutputBytes + measurement.InputBytes, measurement.ExecuteSeconds),
+                   totalSeconds * 1000, ResultName(measurement.Status));
+    }
+}
+
+// Workload names come from file names, which are assumed not to need escaping.
+void PrintJson(const Vector<Measurement> &measurements)
+{
+    fmt::print("[\n");
+    for (std::size_t index = 0; index < measurements.size(); ++index)
+    {
+        const auto &measurement = measurements[index];
+        fmt::print("  {{\"workload\": \"{}\", \"backend\": \"{}\", \"source_bytes\": {}, \"instructions\": {}, "
+                   "\"lex_seconds\": {:.9f}, \"compile_seconds\": {:.9f}, \"execute_seconds\": {:.9f}, "
+                   "\"output_bytes\": {}, \"input_bytes\": {}, \"status\": \"{}\"}}{}\n",
+                   measurement.Workload, measurement.Backend, measurement.SourceBytes, measurement.Instructions,
+                   measurement.LexSeconds, measurement.CompileSeconds, measurement.ExecuteSeconds,
+                   measurement.OutputBytes, measurement.InputBytes, ResultName(measurement.Status),
+                   index + 1 < measurements.size() ? "," : "");
+    }
+    fmt::print("]\n");
+}
+
+void RunBenchmarks(const Arguments &arguments)
+{
+    if (!arguments.Repetitions)
+    {
+        throw Exception("the number of repetitions must be positive");
+    }
+
+    auto backends = arguments.Backend == "all" ? Vector<String>{"interp", "mir", "tiered"}
+                                               : Vector<String>{arguments.Backend};
+    if (arguments.Backend == "all" && X64Compiler::IsSupported())
+    {
+        backends.push_back("x64");
+    }
+    auto workloads = LoadWorkloads(arguments.CorpusDirectory);
+    for (auto &workload : GenerateWorkloads())
+    {
+        workloads.push_back(std::move(workload));
+    }
+
+    Vector<Measurement> measurements;
+    for (const auto &workload : workloads)
+    {
+        for (const auto &backend : backends)
+        {
+            measurements.push_back(Measure(workload, backend, arguments));
+        }
+    }
+
+    if (arguments.Json)
+    {
+        PrintJson(measurements);
+    }
+    else
+    {
+        PrintTable(measurements);
+    }
+}
+} // namespace
+
+int main(int argc, const char **argv)
+{
+    try
+    {
+        const auto arguments = ParseArguments(argv + 1, argv + argc);
+        try
+        {
+            RunBenchmarks(arguments);
+            return 0;
+        }
+        catch (Exception &ex)
+        {
+            fmt::print("failed to run benchmarks: {}\n", ex.reason());
+        }
+        catch (std::filesystem::filesystem_error &ex)
+        {
+            fmt::print("failed to load corpus: {}\n", ex.what());
+        }
+    }
+    catch (Exception &ex)
+    {
+        fmt::print("failed to parse command line arguments: {}\n", ex.reason());
+    }
+
+    return 1;
+}
@@ -1,83 +1,327 @@
+#include "aot.hpp"
 #include "arguments.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include "lexer.hpp"
 #include "mir_compiler.hpp"
+#include "profile.hpp"
+#include "program.hpp"
+#include "statistics.hpp"
+#include "tape.hpp"
+#include "x64_compiler.hpp"
 
 #include <fmt/format.h>
 
 #include <cassert>
-#include <fstream>
-#include <iostream>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <thread>
 #include <vector>
 
+#include <unistd.h>
+
 using namespace bfjit;
 
 struct Arguments
 {
     String FileName;
-    UInt32 HeapSize = 1 << 20;
+    UInt64 HeapSize = 1 << 20;
+    UInt64 MaxHeapSize = 0;
+    Boolean HugePages = false;
+    UInt32 GuardSize = 0;
+    UInt32 CellBits = 8;
+    UInt64 PrefixSteps = 0;
+    UInt32 OptimizationLevel = 2;
+    Boolean Tiered = false;
+    Boolean Cache = false;
+    Boolean Stats = false;
+    Boolean Profile = false;
+    String Backend;
+    Boolean Batch = false;
+    UInt32 Jobs = 0;
+    UInt32 CompileThreads = 1;
+    Boolean Lazy = false;
+    String Emit;
+    String OutputPath;
 };
 
-Result WriteChar(CharType c)
+template <typename Iterator> Arguments ParseArguments(Iterator first, Iterator last)
+{
+    Arguments args;
+    cli::ParseArguments(
+        first, last,
+        cli::Argument(args.FileName)
+            .WithDescription("The path to a file containing brainfuck sources, or to a manifest in batch mode")
+            .Required(),
+        cli::Argument(args.HeapSize)
+            .WithName("--heap-size")
+            .WithDescription("The size of heap, in bytes, available to the VM")
+            .WithDefaultValue("1048576"),
+        cli::Argument(args.MaxHeapSize)
+            .WithName("--max-heap-size")
+            .WithDescription("The size, in bytes, the heap may grow to when the VM runs past its end")
+            .WithDefaultValue("0"),
+        cli::Argument(args.HugePages)
+            .WithName("--huge-pages")
+            .WithDescription("Back the heap with transparent huge pages")
+            .Flag(),
+        cli::Argument(args.GuardSize)
+            .WithName("--guard-size")
+            .WithDescription("The size of inaccessible regions around the heap replacing bounds checks, 0 disables them")
+            .WithDefaultValue("0"),
+        cli::Argument(args.CellBits)
+            .WithName("--cell-bits")
+            .WithDescription("The width of cells in bits: 8, 16, 32 or 64")
+            .WithDefaultValue("8"),
+        cli::Argument(args.PrefixSteps)
+            .WithName("--prefix-steps")
+            .WithDescription("The number of operations run at compile time before the first input, 0 disables it")
+            .WithDefaultValue("0"),
+        cli::Argument(args.OptimizationLevel)
+            .WithName("--opt-level")
+            .WithDescription("The optimization level, 0 to 3, used to generate code")
+            .WithDefaultValue("2"),
+        cli::Argument(args.Tiered)
+            .WithName("--tiered")
+            .WithDescription("Start with quickly generated code and optimize hot loops while running")
+            .Flag(),
+        cli::Argument(args.Cache)
+            .WithName("--cache")
+            .WithDescription("Reuse code compiled by previous runs of the same program")
+            .Flag(),
+        cli::Argument(args.Stats)
+            .WithName("--stats")
+            .WithDescription("Print the time spent in every phase and the size of the generated code to stderr")
+            .Flag(),
+        cli::Argument(args.Profile)
+            .WithName("--profile")
+            .WithDescription("Count loop entries and iterations, and print the hottest loops to stderr")
+            .Flag(),
+        cli::Argument(args.Backend)
+            .WithName("--backend")
+            .WithDescription("The backend running the program: `mir`, `x64` or `interp`")
+            .WithDefaultValue("mir"),
+        cli::Argument(args.Batch)
+            .WithName("--batch")
+            .WithDescription("Run every job listed in the manifest at the file path in parallel")
+            .Flag(),
+        cli::Argument(args.Jobs)
+            .WithName("--jobs")
+            .WithDescription("The number of threads running batch jobs, 0 uses one per core")
+            .WithDefaultValue("0"),
+        cli::Argument(args.CompileThreads)
+            .WithName("--compile-threads")
+            .WithDescription("The number of threads generating code, 0 uses one per core")
+            .WithDefaultValue("1"),
+        cli::Argument(args.Lazy)
+            .WithName("--lazy")
+            .WithDescription("Compile large loops when they're first entered instead of before the program starts")
+            .Flag(),
+        cli::Argument(args.Emit)
+            .WithName("--emit")
+            .WithDescription("Write the program out as an `exe` or `obj` file running on its own instead of running it"),
+        cli::Argument(args.OutputPath)
+            .WithName("--output")
+            .WithDescription("The path of the file written by `--emit`, derived from the file path by default"));
+
+    return args;
+}
+
+UInt32 CountThreads(UInt32 requested)
 {
-    if (!(std::cout.put(c)))
+    return requested ? requested : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+std::unique_ptr<CompilerBackend> CreateBackend(const Arguments &arguments, UInt32 generatorThreads)
+{
+    if (arguments.Backend == "mir")
     {
-        return Result::WriteError;
+        return std::make_unique<MirCompiler>(MirCompilerOptions{
+            .OptimizationLevel = arguments.OptimizationLevel,
+            .Tiered = arguments.Tiered,
+            .CacheDirectory = arguments.Cache ? Optional<String>(CompilationCache::DefaultDirectory()) : std::nullopt,
+            .GeneratorThreads = generatorThreads,
+            .Lazy = arguments.Lazy,
+        });
     }
-    else
+
+    if (arguments.Backend == "interp")
     {
-        return Result::Success;
+        return std::make_unique<Interpreter>();
     }
+
+    if (arguments.Backend == "x64")
+    {
+        return std::make_unique<X64Compiler>();
+    }
+
+    throw Exception::Formatted("unknown backend {}", arguments.Backend);
 }
 
-Result ReadChar(CharPtr target)
+TapeOptions CreateTapeOptions(const Arguments &arguments)
 {
-    assert(target);
+    return TapeOptions{
+        .Size = arguments.HeapSize,
+        .MaxSize = arguments.MaxHeapSize,
+        .GuardSize = arguments.GuardSize,
+        .HugePages = arguments.HugePages,
+    };
+}
+
+struct RunStatistics
+{
+    double LexSeconds = 0;
+    UInt64 Instructions = 0;
+    CompilerStatistics Compiler;
+    double ExecuteSeconds = 0;
+    UInt64 CommittedBytes = 0;
+};
+
+void PrintStatistics(const RunStatistics &statistics)
+{
+    const auto &compiler = statistics.Compiler;
+    fmt::print(stderr, "lex       {:>12.3f} ms  {} instructions\n", statistics.LexSeconds * 1000,
+               statistics.Instructions);
+    fmt::print(stderr, "ir build  {:>12.3f} ms\n", compiler.BuildSeconds * 1000);
+    fmt::print(stderr, "emit      {:>12.3f} ms  {} mir instructions, {} registers, {} labels\n",
+               compiler.EmitSeconds * 1000, compiler.MirInstructions, compiler.MirRegisters, compiler.MirLabels);
+    fmt::print(stderr, "load      {:>12.3f} ms\n", compiler.LoadSeconds * 1000);
+    fmt::print(stderr, "generate  {:>12.3f} ms  {} bytes of code\n", compiler.GenerateSeconds * 1000,
+               compiler.CodeBytes);
+    fmt::print(stderr, "execute   {:>12.3f} ms  {} bytes of heap committed\n", statistics.ExecuteSeconds * 1000,
+               statistics.CommittedBytes);
+}
+
+Result RunFile(const Arguments &arguments)
+{
+    RunStatistics statistics;
+
+    const Stopwatch lexStopwatch;
+    const SourceFile source(arguments.FileName);
+    const auto instructions = LexInstructions(source.Text());
+    statistics.LexSeconds = lexStopwatch.ElapsedSeconds();
+    statistics.Instructions = instructions.size();
+
+    Tape tape(CreateTapeOptions(arguments));
+
+    LoopProfile profile;
+    const auto backend = CreateBackend(arguments, CountThreads(arguments.CompileThreads));
+    SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+    CompilerContext compilerContext{
+        .Reader = &reader,
+        .GuardSize = tape.GuardSize(),
+        .CellBits = arguments.CellBits,
+        .PrefixSteps = arguments.PrefixSteps,
+        .Statistics = arguments.Stats ? &statistics.Compiler : nullptr,
+        .Profile = arguments.Profile ? &profile : nullptr,
+    };
+    const CompiledProgram program(*backend, compilerContext);
+
+    FileOutputBuffer output(STDOUT_FILENO);
+    FileInputBuffer input(STDIN_FILENO, &output);
+    const Stopwatch executeStopwatch;
+    const auto result = program.Run(tape, output, input);
+    const auto flushResult = output.FlushAll();
+    statistics.ExecuteSeconds = executeStopwatch.ElapsedSeconds();
+    statistics.CommittedBytes = tape.CommittedSize();
 
-    CharType c;
-    if (!(std::cin.get(c)))
+    if (arguments.Stats)
     {
-        return Result::ReadError;
+        PrintStatistics(statistics);
     }
-    else
+
+    if (arguments.Profile)
     {
-        *target = c;
-        return Result::Success;
+        PrintLoopProfile(stderr, profile, source.Text(), instructions, 20);
     }
+
+    return result == Result::Success ? flushResult : result;
 }
 
-template <typename Iterator> Arguments ParseArguments(Iterator first, Iterator last)
+// Compiles the program with the x64 backend, the other ones only generating code in memory.
+int EmitFile(const Arguments &arguments)
 {
-    Arguments args;
-    cli::ParseArguments(
-        first, last,
-        cli::Argument(args.FileName).WithDescription("The path to a file containing brainfuck sources").Required(),
-        cli::Argument(args.HeapSize)
-            .WithName("--heap-size")
-            .WithDescription("The size of heap, in bytes, available to the VM")
-            .WithDefaultValue("1048576"));
+    // The emitted runtime sets up a plain heap of its own, and the program is always compiled by the x64 backend.
+    if (arguments.MaxHeapSize || arguments.HugePages || arguments.GuardSize)
+    {
+        throw Exception("--max-heap-size, --huge-pages and --guard-size can't be used with --emit");
+    }
 
-    return args;
+    if (arguments.Backend != "mir" || arguments.Tiered || arguments.Lazy || arguments.Cache)
+    {
+        throw Exception("--backend, --tiered, --lazy and --cache can't be used with --emit");
+    }
+
+    if (arguments.Stats || arguments.Profile || arguments.Batch)
+    {
+        throw Exception("--stats, --profile and --batch can't be used with --emit");
+    }
+
+    const auto kind = ParseEmitKind(arguments.Emit);
+    auto outputPath = arguments.OutputPath;
+    if (outputPath.empty())
+    {
+        const auto stem = std::filesystem::path(arguments.FileName).replace_extension();
+        outputPath = kind == EmitKind::Object ? stem.string() + ".o" : stem.string();
+    }
+
+    const SourceFile source(arguments.FileName);
+    const auto instructions = LexInstructions(source.Text());
+    SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+    const auto compiler = std::getenv("CC");
+    EmitProgram(CompilerContext{.Reader = &reader, .CellBits = arguments.CellBits, .PrefixSteps = arguments.PrefixSteps},
+                EmitOptions{
+                    .Kind = kind,
+                    .OutputPath = outputPath,
+                    .TapeSize = arguments.HeapSize,
+                    .Compiler = compiler && *compiler ? compiler : "cc",
+                });
+
+    return 0;
 }
 
-Result RunFile(const String &sourceFile, UInt32 heapSize)
+// Reports every job on a line of its own and fails unless all of them succeed.
+int RunBatchFile(const Arguments &arguments)
 {
-    std::ifstream sourceFileStream;
-    sourceFileStream.open(sourceFile, std::ios::in);
-    if (!sourceFileStream.is_open())
+    // Neither is collected per job.
+    if (arguments.Stats || arguments.Profile)
     {
-        throw Exception::Formatted("failed to open source file {}", sourceFile);
+        throw Exception("--stats and --profile can't be used in batch mode");
     }
 
-    MirCompiler compiler;
-    IteratorInstructionReader reader(std::istream_iterator<char>{sourceFileStream}, std::istream_iterator<char>{});
-    CompilerContext compilerContext{
-        .WriteChar = WriteChar,
-        .ReadChar = ReadChar,
-        .Reader = &reader,
-    };
-    const auto entrypoint = compiler.Compile(compilerContext);
+    const auto jobs = ReadBatchManifest(arguments.FileName);
+    const auto workers = CountThreads(arguments.Jobs);
+    const auto generatorThreads = CountThreads(arguments.CompileThreads);
+    const auto results = RunBatch(jobs, BatchOptions{
+                                            .Workers = workers,
+                                            .Tape = CreateTapeOptions(arguments),
+                                            .CellBits = arguments.CellBits,
+                                            .PrefixSteps = arguments.PrefixSteps,
+                                            .CreateBackend = [&] { return CreateBackend(arguments, generatorThreads); },
+                                        });
+
+    auto failures = 0;
+    for (std::size_t index = 0; index < jobs.size(); ++index)
+    {
+        const auto &result = results[index];
+        if (result.Error)
+        {
+            fmt::print("{:>6} {}: error: {}\n", index, jobs[index].Program, *result.Error);
+            ++failures;
+            continue;
+        }
+
+        fmt::print("{:>6} {}: {} ({}), compile {:.3f} ms, execute {:.3f} ms\n", index, jobs[index].Program,
+                   ResultName(result.Status), static_cast<int>(result.Status), result.CompileSeconds * 1000,
+                   result.ExecuteSeconds * 1000);
+        failures += result.Status != Result::Success;
+    }
 
-    Vector<CharType> heap(heapSize);
-    return entrypoint(heap.data(), heap.data() + heap.size());
+    fmt::print("{} of {} jobs succeeded on {} workers\n", jobs.size() - failures, jobs.size(), workers);
+    return failures ? 1 : 0;
 }
 
 int main(int argc, const char **argv)
@@ -87,7 +331,12 @@ int main(int argc, const char **argv)
         const auto arguments = ParseArguments(argv + 1, argv + argc);
         try
         {
-            return static_cast<int>(RunFile(arguments.FileName, arguments.HeapSize));
+            if (!arguments.Emit.empty())
+            {
+                return EmitFile(arguments);
+            }
+
+            return arguments.Batch ? RunBatchFile(arguments) : static_cast<int>(RunFile(arguments));
         }
         catch (Exception &ex)
         {
@@ -0,0 +1,191 @@
+#include "cache.hpp"
+#include "exception.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include <unistd.h>
+
+using namespace bfjit;
+
+namespace
+{
+constexpr inline std::array<char, 8> EntryMagic = {'b', 'f', 'j', 'i', 't', 'c', '0', '2'};
+constexpr inline UInt64 FnvOffsetBasis = 0xcbf29ce484222325;
+constexpr inline UInt64 FnvPrime = 0x100000001b3;
+
+// Tells apart the temporary files of threads storing the same entry at once.
+std::atomic<UInt64> TemporaryFileCounter = 0;
+
+UInt64 HashBytes(const CharType *data, std::size_t size) noexcept
+{
+    auto hash = FnvOffsetBasis;
+    for (std::size_t index = 0; index < size; ++index)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[index])) * FnvPrime;
+    }
+
+    return hash;
+}
+
+Optional<Vector<CharType>> ReadFile(const String &path)
+{
+    FilePtr file(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    Vector<CharType> contents;
+    std::array<CharType, 1 << 16> chunk;
+    while (const auto count = std::fread(chunk.data(), 1, chunk.size(), file.get()))
+    {
+        contents.insert(contents.end(), chunk.data(), chunk.data() + count);
+    }
+
+    if (std::ferror(file.get()))
+    {
+        return std::nullopt;
+    }
+
+    return contents;
+}
+
+// Reads the value at `position` and moves past it, unless the entry ends before it does.
+template <typename Type> Boolean ReadValue(const Vector<CharType> &entry, std::size_t &position, Type &value) noexcept
+{
+    static_assert(std::is_trivially_copyable_v<Type>);
+
+    if (entry.size() - position < sizeof(value))
+    {
+        return false;
+    }
+
+    std::memcpy(&value, entry.data() + position, sizeof(value));
+    position += sizeof(value);
+    return true;
+}
+
+// Compares the bytes at `position` with `expected` and moves past them.
+Boolean ReadBytes(const Vector<CharType> &entry, std::size_t &position, const Vector<CharType> &expected) noexcept
+{
+    UInt64 size = 0;
+    if (!ReadValue(entry, position, size) || size != expected.size() || entry.size() - position < size ||
+        !std::equal(expected.begin(), expected.end(), entry.begin() + static_cast<std::ptrdiff_t>(position)))
+    {
+        return false;
+    }
+
+    position += size;
+    return true;
+}
+} // namespace
+
+CacheKey &CacheKey::Add(const void *data, std::size_t size) noexcept
+{
+    assert(data || !size);
+
+    const auto bytes = static_cast<const CharType *>(data);
+    m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+    return *this;
+}
+
+UInt64 CacheKey::Hash() const noexcept
+{
+    return HashBytes(m_bytes.data(), m_bytes.size());
+}
+
+const Vector<CharType> &CacheKey::Bytes() const noexcept
+{
+    return m_bytes;
+}
+
+CompilationCache::CompilationCache(String directory) : m_directory(std::move(directory))
+{
+}
+
+String CompilationCache::DefaultDirectory()
+{
+    if (const auto cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome && *cacheHome)
+    {
+        return fmt::format("{}/bfjit", cacheHome);
+    }
+
+    if (const auto home = std::getenv("HOME"); home && *home)
+    {
+        return fmt::format("{}/.cache/bfjit", home);
+    }
+
+    throw Exception("failed to locate cache directory: neither XDG_CACHE_HOME nor HOME is set");
+}
+
+// An entry holds the magic, the key, then the size and hash of its contents, followed by the contents themselves.
+// Entries of other keys sharing the hash, and entries cut short or damaged on disk, are ignored.
+Optional<Vector<CharType>> CompilationCache::Load(const CacheKey &key) const
+{
+    const auto entry = ReadFile(EntryPath(key.Hash()));
+    if (!entry)
+    {
+        return std::nullopt;
+    }
+
+    std::size_t position = 0;
+    std::array<char, EntryMagic.size()> magic;
+    UInt64 size = 0;
+    UInt64 hash = 0;
+    if (!ReadValue(*entry, position, magic) || magic != EntryMagic || !ReadBytes(*entry, position, key.Bytes()) ||
+        !ReadValue(*entry, position, size) || !ReadValue(*entry, position, hash) || entry->size() - position != size ||
+        HashBytes(entry->data() + position, size) != hash)
+    {
+        return std::nullopt;
+    }
+
+    return Vector<CharType>(entry->begin() + static_cast<std::ptrdiff_t>(position), entry->end());
+}
+
+Boolean CompilationCache::Store(const CacheKey &key, const Vector<CharType> &contents) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error)
+    {
+        return false;
+    }
+
+    const auto path = EntryPath(key.Hash());
+    const auto temporaryPath = fmt::format("{}.{}.{}.tmp", path, getpid(), TemporaryFileCounter++);
+    FilePtr file(std::fopen(temporaryPath.c_str(), "wb"), std::fclose);
+    if (!file)
+    {
+        return false;
+    }
+
+    const auto &bytes = key.Bytes();
+    const UInt64 keySize = bytes.size();
+    const UInt64 size = contents.size();
+    const auto hash = HashBytes(contents.data(), contents.size());
+    std::fwrite(EntryMagic.data(), EntryMagic.size(), 1, file.get());
+    std::fwrite(&keySize, sizeof(keySize), 1, file.get());
+    std::fwrite(bytes.data(), 1, bytes.size(), file.get());
+    std::fwrite(&size, sizeof(size), 1, file.get());
+    std::fwrite(&hash, sizeof(hash), 1, file.get());
+    std::fwrite(contents.data(), 1, contents.size(), file.get());
+    const auto isWritten = !std::ferror(file.get()) && std::fclose(file.release()) == 0;
+    if (!isWritten || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+String CompilationCache::EntryPath(UInt64 key) const
+{
+    return fmt::format("{}/{:016x}.mirb", m_directory, key);
+}
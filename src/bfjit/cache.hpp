@@ -0,0 +1,68 @@
+#ifndef BFJIT_CACHE_HPP
+#define BFJIT_CACHE_HPP
+
+#include "types.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <type_traits>
+
+namespace bfjit
+{
+// Collects everything a compiled program depends on. Entries are named after a 64-bit FNV-1a hash of it, but keep a
+// full copy to compare against, so that colliding keys never share an entry.
+class CacheKey
+{
+public:
+    CacheKey &Add(const void *data, std::size_t size) noexcept;
+
+    template <typename Type> CacheKey &Add(const Type &value) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<Type>);
+
+        return Add(&value, sizeof(value));
+    }
+
+    template <typename Type> CacheKey &Add(const Vector<Type> &values) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<Type>);
+
+        Add(values.size());
+        return Add(values.data(), values.size() * sizeof(Type));
+    }
+
+    UInt64 Hash() const noexcept;
+
+    const Vector<CharType> &Bytes() const noexcept;
+
+private:
+    Vector<CharType> m_bytes;
+};
+
+using FilePtr = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+
+// Keeps compiled programs on disk, one file per key. The cache is only an optimization, so entries which can't be
+// stored are silently dropped, and entries which can't be read back are treated as missing.
+class CompilationCache
+{
+public:
+    explicit CompilationCache(String directory);
+
+    // `$XDG_CACHE_HOME/bfjit`, or `$HOME/.cache/bfjit` when the former isn't set.
+    static String DefaultDirectory();
+
+    // Returns the contents stored under `key`, or nothing if there are none or they don't pass their checksum.
+    Optional<Vector<CharType>> Load(const CacheKey &key) const;
+
+    // The entry is written to a temporary file which is then renamed, so that concurrent runs never see it partially
+    // written.
+    Boolean Store(const CacheKey &key, const Vector<CharType> &contents) const;
+
+private:
+    String EntryPath(UInt64 key) const;
+
+    String m_directory;
+};
+} // namespace bfjit
+
+#endif // BFJIT_CACHE_HPP
@@ -0,0 +1,51 @@
+#ifndef BFJIT_CELL_HPP
+#define BFJIT_CELL_HPP
+
+#include "exception.hpp"
+#include "types.hpp"
+
+#include <limits>
+
+namespace bfjit
+{
+// Describes the cells of a tape, which wrap around on overflow. Programs are compiled for a single cell type, and
+// backends specialize their code for it at compile time rather than checking the width while the program runs.
+template <typename Value_> struct CellPolicy
+{
+    using Value = Value_;
+
+    static constexpr UInt32 Bits = 8 * sizeof(Value);
+    static constexpr Int64 Bytes = sizeof(Value);
+
+    // Whether `value` is within the range of the cell, that is, whether storing and loading it back keeps it intact.
+    static constexpr Boolean IsNormalized(Int64 value) noexcept
+    {
+        return Bits == 64 || (value >= 0 && static_cast<UInt64>(value) <= std::numeric_limits<Value>::max());
+    }
+};
+
+using Cell8 = CellPolicy<std::uint8_t>;
+using Cell16 = CellPolicy<std::uint16_t>;
+using Cell32 = CellPolicy<std::uint32_t>;
+using Cell64 = CellPolicy<std::uint64_t>;
+
+// Calls `function` with the policy of the cells `bits` wide.
+template <typename Function> decltype(auto) DispatchCellBits(UInt32 bits, Function &&function)
+{
+    switch (bits)
+    {
+    case 8:
+        return function(Cell8{});
+    case 16:
+        return function(Cell16{});
+    case 32:
+        return function(Cell32{});
+    case 64:
+        return function(Cell64{});
+    }
+
+    throw Exception::Formatted("unsupported cell width {}, expected 8, 16, 32 or 64", bits);
+}
+} // namespace bfjit
+
+#endif // BFJIT_CELL_HPP
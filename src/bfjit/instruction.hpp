@@ -1,9 +1,11 @@
 #ifndef BFJIT_INSTRUCTION_HPP
 #define BFJIT_INSTRUCTION_HPP
 
+#include <cstdint>
+
 namespace bfjit
 {
-enum class Instruction
+enum class Instruction : std::uint8_t
 {
     Invalid,
     Inc,
@@ -63,6 +65,23 @@ private:
     Iterator m_first;
     Iterator m_last;
 };
+// Replays instructions which have already been read.
+class SequenceInstructionReader final : public InstructionReader
+{
+public:
+    explicit SequenceInstructionReader(const Instruction *first, const Instruction *last) : m_first(first), m_last(last)
+    {
+    }
+
+    Instruction Next() override
+    {
+        return m_first != m_last ? *m_first++ : Instruction::Invalid;
+    }
+
+private:
+    const Instruction *m_first;
+    const Instruction *m_last;
+};
 } // namespace bfjit
 
 #endif // BFJIT_INSTRUCTION_HPP
@@ -0,0 +1,536 @@
+#include "interpreter.hpp"
+#include "cell.hpp"
+#include "exception.hpp"
+#include "io.hpp"
+#include "ir.hpp"
+#include "prefix.hpp"
+#include "profile.hpp"
+#include "scan.hpp"
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+using namespace bfjit;
+
+namespace
+{
+enum class Opcode : std::uint8_t
+{
+    AddCell,
+    SetCell,
+    MovePtr,
+    MovePtrChecked,
+    JumpIfZero,
+    JumpIfNotZero,
+    CheckRange,
+    MultiplyAdd,
+    ScanForward,
+    ScanBackward,
+    WriteChar,
+    ReadChar,
+    StoreBlock,
+    WriteBlock,
+    Count,
+    Exit,
+    ExitChecked,
+};
+
+// `Value` holds the operand, or the index of the target for jumps, and `Offset` the cell operated on relative to the
+// current one; offsets and distances are counted in cells. `CheckRange` verifies that the cells from `Offset` to
+// `Value` relative to the current one are on the tape. `Count` increments the profile counter `Value` points to, and
+// the block operations take the `Offset` bytes `Value` points to.
+struct Instruction
+{
+    Opcode Code;
+    Int64 Offset = 0;
+    Int64 Value = 0;
+};
+
+using Bytecode = Vector<Instruction>;
+
+template <typename Cell> struct BytecodeCompiler
+{
+    UInt32 GuardSize = 0;
+    LoopProfile *Profile = nullptr;
+    std::size_t NextProfiledLoop = 0;
+    // The cells from `KnownMinOffset` to `KnownMaxOffset` relative to the current one are on the tape, as something
+    // would have failed on the way here otherwise.
+    Int64 KnownMinOffset = 0;
+    Int64 KnownMaxOffset = 0;
+    Bytecode Code;
+
+    Bytecode Compile(const ir::Program &program)
+    {
+        EmitOperations(program);
+        Append(GuardSize ? Opcode::ExitChecked : Opcode::Exit);
+
+        return std::move(Code);
+    }
+
+    void EmitOperations(const ir::Program &operations)
+    {
+        for (const auto &operation : operations)
+        {
+            switch (operation.Kind)
+            {
+            case ir::OperationKind::AddCell:
+                EmitRangeCheck(operation.Offset, operation.Offset);
+                Append(Opcode::AddCell, operation.Offset, operation.Value);
+                break;
+            case ir::OperationKind::SetCell:
+                EmitRangeCheck(operation.Offset, operation.Offset);
+                Append(Opcode::SetCell, operation.Offset, operation.Value);
+                break;
+            case ir::OperationKind::MovePtr:
+                EmitMovePtrOperation(operation.Value);
+                break;
+            case ir::OperationKind::Loop:
+                EmitLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyLoop:
+                EmitLoopEntryCount(operation);
+                EmitMultiplyLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyAdd:
+                assert(false);
+                break;
+            case ir::OperationKind::ScanLoop:
+                EmitLoopEntryCount(operation);
+                Append(operation.Value > 0 ? Opcode::ScanForward : Opcode::ScanBackward, 0,
+                       operation.Value > 0 ? operation.Value : -operation.Value);
+                ForgetRange();
+                break;
+            case ir::OperationKind::WriteChar:
+                EmitRangeCheck(operation.Offset, operation.Offset);
+                Append(Opcode::WriteChar, operation.Offset);
+                break;
+            case ir::OperationKind::ReadChar:
+                EmitRangeCheck(operation.Offset, operation.Offset);
+                Append(Opcode::ReadChar, operation.Offset);
+                break;
+            case ir::OperationKind::StoreBlock:
+                EmitBlockCheck(operation.Value);
+                AppendBlock(Opcode::StoreBlock, operation.Data);
+                break;
+            case ir::OperationKind::WriteBlock:
+                AppendBlock(Opcode::WriteBlock, operation.Data);
+                break;
+            }
+        }
+    }
+
+    // A move left to the guard regions only tells where the pointer is once a cell is accessed there.
+    void EmitMovePtrOperation(Int64 distance)
+    {
+        const auto isKnown = IsKnown(distance, distance);
+        const auto isChecked = !isKnown && IsChecked(distance, distance);
+        Append(isChecked ? Opcode::MovePtrChecked : Opcode::MovePtr, 0, distance);
+        ShiftRange(distance, isKnown || isChecked);
+    }
+
+    // Balanced loops start every iteration where they were entered, so the cells all of their iterations access are
+    // checked once before the first one. Other loops are entered anew by every iteration, and so are they left.
+    void EmitLoopOperation(const ir::Operation &loop)
+    {
+        const auto counters = EmitLoopEntryCount(loop);
+        const auto open = Append(Opcode::JumpIfZero);
+        const auto range = ir::AnalyzeLoopRange(loop);
+        const auto knownMinOffset = KnownMinOffset;
+        const auto knownMaxOffset = KnownMaxOffset;
+        if (range.IsBalanced)
+        {
+            EmitRangeCheck(range.MinOffset, range.MaxOffset);
+        }
+        else
+        {
+            ForgetRange();
+        }
+
+        const auto body = Code.size();
+        if (counters)
+        {
+            EmitCount(&counters->Iterations);
+        }
+
+        if (!range.IsBalanced)
+        {
+            EmitRangeCheck(range.MinOffset, range.MaxOffset);
+        }
+        EmitOperations(loop.Body);
+        const auto close = Append(Opcode::JumpIfNotZero, 0, static_cast<Int64>(body));
+        Code[open].Value = static_cast<Int64>(close + 1);
+
+        if (range.IsBalanced)
+        {
+            KnownMinOffset = knownMinOffset;
+            KnownMaxOffset = knownMaxOffset;
+        }
+        else
+        {
+            ForgetRange();
+        }
+    }
+
+    // Loops are instrumented in the order they appear in, matching the counters listed by `LoopProfile::Reset`.
+    LoopCounters *EmitLoopEntryCount(const ir::Operation &loop)
+    {
+        if (!Profile)
+        {
+            return nullptr;
+        }
+
+        assert(NextProfiledLoop < Profile->Loops.size());
+        auto &counters = Profile->Loops[NextProfiledLoop++];
+        assert(counters.Kind == loop.Kind && counters.Position == loop.Position);
+
+        EmitCount(&counters.Entries);
+        return &counters;
+    }
+
+    void EmitCount(UInt64 *counter)
+    {
+        Append(Opcode::Count, 0, reinterpret_cast<Int64>(counter));
+    }
+
+    void EmitMultiplyLoopOperation(const ir::Operation &loop)
+    {
+        const auto &body = loop.Body;
+        assert(!body.empty());
+
+        // The check only runs when the loop does, so it isn't remembered. Within the guard regions the outermost target
+        // faults by itself, as long as the loop has targets on one side only and adds something to it. Otherwise the
+        // range is tested, and since `CheckRange` tests its end before its start, the start is tested on its own first
+        // when the loop would have run off it first.
+        const auto minOffset = body.front().Offset;
+        const auto maxOffset = body.back().Offset;
+        const auto isTwoSided = minOffset < 0 && maxOffset > 0;
+        const auto &outermost = maxOffset > 0 ? body.back() : body.front();
+        const auto isFaulting = !isTwoSided && outermost.Value != 0;
+        const auto skip = Append(Opcode::JumpIfZero);
+        if (!IsKnown(minOffset, maxOffset) && (IsChecked(minOffset, maxOffset) || !isFaulting))
+        {
+            if (isTwoSided && loop.Value == minOffset)
+            {
+                Append(Opcode::CheckRange, minOffset, minOffset);
+            }
+            Append(Opcode::CheckRange, minOffset, maxOffset);
+        }
+
+        for (const auto &operation : body)
+        {
+            if (operation.Value != 0)
+            {
+                Append(Opcode::MultiplyAdd, operation.Offset, operation.Value);
+            }
+        }
+
+        Append(Opcode::SetCell, 0, 0);
+        Code[skip].Value = static_cast<Int64>(Code.size());
+    }
+
+    // Mirrors the compiler: accesses within the guard regions fault on their own.
+    Boolean IsChecked(Int64 minOffset, Int64 maxOffset) const noexcept
+    {
+        const auto guardCells = static_cast<Int64>(GuardSize) / Cell::Bytes;
+        return maxOffset > guardCells || -minOffset > guardCells;
+    }
+
+    Boolean IsKnown(Int64 minOffset, Int64 maxOffset) const noexcept
+    {
+        return minOffset >= KnownMinOffset && maxOffset <= KnownMaxOffset;
+    }
+
+    // The tape is contiguous, so every cell between the current one and a checked one is on it as well. Cells left to
+    // the guard regions aren't known to be on the tape until they're accessed, so they aren't remembered.
+    void EmitRangeCheck(Int64 minOffset, Int64 maxOffset)
+    {
+        if (IsKnown(minOffset, maxOffset) || !IsChecked(minOffset, maxOffset))
+        {
+            return;
+        }
+
+        Append(Opcode::CheckRange, minOffset, maxOffset);
+        KnownMinOffset = std::min(KnownMinOffset, minOffset);
+        KnownMaxOffset = std::max(KnownMaxOffset, maxOffset);
+    }
+
+    // Blocks may cover cells they never touch, so they're checked regardless of the guard regions.
+    void EmitBlockCheck(Int64 cells)
+    {
+        assert(cells > 0);
+
+        if (IsKnown(0, cells - 1))
+        {
+            return;
+        }
+
+        Append(Opcode::CheckRange, 0, cells - 1);
+        KnownMaxOffset = std::max(KnownMaxOffset, cells - 1);
+    }
+
+    void ForgetRange() noexcept
+    {
+        KnownMinOffset = 0;
+        KnownMaxOffset = 0;
+    }
+
+    // The cells known to be on the tape stay there when the pointer moves, and so does the one it moves to when the
+    // move was checked.
+    void ShiftRange(Int64 distance, Boolean isChecked) noexcept
+    {
+        if (isChecked)
+        {
+            KnownMinOffset = std::min(KnownMinOffset, distance);
+            KnownMaxOffset = std::max(KnownMaxOffset, distance);
+        }
+        KnownMinOffset -= distance;
+        KnownMaxOffset -= distance;
+    }
+
+    std::size_t Append(Opcode code, Int64 offset = 0, Int64 value = 0)
+    {
+        Code.push_back(Instruction{.Code = code, .Offset = offset, .Value = value});
+        return Code.size() - 1;
+    }
+
+    // The block is referred to rather than copied, so the program has to outlive the bytecode.
+    void AppendBlock(Opcode code, const Vector<CharType> &data)
+    {
+        if (!data.empty())
+        {
+            Append(code, static_cast<Int64>(data.size()), reinterpret_cast<Int64>(data.data()));
+        }
+    }
+};
+
+// The room left is measured before moving, so that a huge distance can't wrap the pointer around.
+template <typename Value>
+Result CheckRange(const Value *current, const Value *begin, const Value *end, Int64 minOffset, Int64 maxOffset) noexcept
+{
+    if (maxOffset > 0 && end - current <= maxOffset)
+    {
+        return Result::OutOfMemory;
+    }
+
+    if (minOffset < 0 && current - begin < -minOffset)
+    {
+        return Result::MemoryUnderrun;
+    }
+
+    return Result::Success;
+}
+
+// Dispatches through a table of label addresses, so that every handler ends with its own indirect jump. Cell
+// arithmetic is carried out on unsigned 64-bit values, which wrap around the same way the cells do.
+template <typename Cell>
+Result Execute(const Bytecode &code, CharPtr tapeBegin, CharPtr tapeEnd, OutputBuffer *output, InputBuffer *input)
+{
+    assert(!code.empty());
+    assert(output);
+    assert(input);
+    assert((tapeEnd - tapeBegin) % Cell::Bytes == 0);
+
+    using Value = typename Cell::Value;
+
+    static const void *const Handlers[] = {
+        &&AddCell,     &&SetCell,     &&MovePtr,      &&MovePtrChecked, &&JumpIfZero, &&JumpIfNotZero, &&CheckRange,
+        &&MultiplyAdd, &&ScanForward, &&ScanBackward, &&WriteChar,      &&ReadChar,   &&StoreBlock,    &&WriteBlock,
+        &&Count,       &&Exit,        &&ExitChecked,
+    };
+
+    const auto first = code.data();
+    const auto begin = reinterpret_cast<Value *>(tapeBegin);
+    const auto end = reinterpret_cast<Value *>(tapeEnd);
+    auto instruction = first;
+    auto current = begin;
+    auto result = Result::Success;
+
+#define BFJIT_DISPATCH() goto *Handlers[static_cast<std::size_t>(instruction->Code)]
+#define BFJIT_NEXT()                                                                                                   \
+    ++instruction;                                                                                                     \
+    BFJIT_DISPATCH()
+
+    BFJIT_DISPATCH();
+
+AddCell:
+    current[instruction->Offset] =
+        static_cast<Value>(current[instruction->Offset] + static_cast<UInt64>(instruction->Value));
+    BFJIT_NEXT();
+
+SetCell:
+    current[instruction->Offset] = static_cast<Value>(instruction->Value);
+    BFJIT_NEXT();
+
+MovePtrChecked:
+    result = CheckRange(current, begin, end, instruction->Value, instruction->Value);
+    if (result != Result::Success)
+    {
+        return result;
+    }
+
+MovePtr:
+    current += instruction->Value;
+    BFJIT_NEXT();
+
+JumpIfZero:
+    if (*current == 0)
+    {
+        instruction = first + instruction->Value;
+        BFJIT_DISPATCH();
+    }
+    BFJIT_NEXT();
+
+JumpIfNotZero:
+    if (*current != 0)
+    {
+        instruction = first + instruction->Value;
+        BFJIT_DISPATCH();
+    }
+    BFJIT_NEXT();
+
+CheckRange:
+    result = CheckRange(current, begin, end, instruction->Offset, instruction->Value);
+    if (result != Result::Success)
+    {
+        return result;
+    }
+    BFJIT_NEXT();
+
+MultiplyAdd:
+    current[instruction->Offset] = static_cast<Value>(current[instruction->Offset] +
+                                                      UInt64(*current) * static_cast<UInt64>(instruction->Value));
+    BFJIT_NEXT();
+
+ScanForward:
+    if (*current != 0)
+    {
+        current = reinterpret_cast<Value *>(
+            bfjit::ScanForward<Cell>(reinterpret_cast<CharPtr>(current), tapeEnd, instruction->Value));
+        if (!current)
+        {
+            return Result::OutOfMemory;
+        }
+    }
+    BFJIT_NEXT();
+
+ScanBackward:
+    if (*current != 0)
+    {
+        current = reinterpret_cast<Value *>(
+            bfjit::ScanBackward<Cell>(reinterpret_cast<CharPtr>(current), tapeBegin, instruction->Value));
+        if (!current)
+        {
+            return Result::MemoryUnderrun;
+        }
+    }
+    BFJIT_NEXT();
+
+WriteChar:
+{
+    // The cell is read first, so that nothing is written out before an access to a guard region faults. Wider cells
+    // are written out as their lowest byte.
+    const auto value = static_cast<CharType>(current[instruction->Offset]);
+    if (output->Cursor == output->Limit)
+    {
+        result = output->Flush(output);
+        if (result != Result::Success)
+        {
+            return result;
+        }
+    }
+    *output->Cursor++ = value;
+    BFJIT_NEXT();
+}
+
+ReadChar:
+    if (input->Cursor == input->Limit)
+    {
+        result = input->Refill(input);
+        if (result != Result::Success)
+        {
+            return result;
+        }
+    }
+    current[instruction->Offset] = static_cast<unsigned char>(*input->Cursor++);
+    BFJIT_NEXT();
+
+StoreBlock:
+    std::memcpy(current, reinterpret_cast<const CharType *>(instruction->Value), instruction->Offset);
+    BFJIT_NEXT();
+
+WriteBlock:
+    result = WriteOutput(output, reinterpret_cast<const CharType *>(instruction->Value),
+                         static_cast<UInt64>(instruction->Offset));
+    if (result != Result::Success)
+    {
+        return result;
+    }
+    BFJIT_NEXT();
+
+Count:
+    ++*reinterpret_cast<UInt64 *>(instruction->Value);
+    BFJIT_NEXT();
+
+ExitChecked:
+    // The last move may have left the tape without touching a cell.
+    if (current >= end)
+    {
+        return Result::OutOfMemory;
+    }
+    if (current < begin)
+    {
+        return Result::MemoryUnderrun;
+    }
+
+Exit:
+    return Result::Success;
+
+#undef BFJIT_NEXT
+#undef BFJIT_DISPATCH
+}
+template <typename Cell> Entrypoint CompileProgram(const CompilerContext &context)
+{
+    const Stopwatch buildStopwatch;
+    auto program = ir::BuildProgram(*context.Reader);
+    ir::Optimize<Cell>(program);
+    if (context.PrefixSteps)
+    {
+        ir::EvaluatePrefix<Cell>(program, context.PrefixSteps);
+    }
+    if (context.Statistics)
+    {
+        context.Statistics->BuildSeconds += buildStopwatch.ElapsedSeconds();
+    }
+
+    if (context.Profile)
+    {
+        context.Profile->Reset(program);
+    }
+
+    const Stopwatch emitStopwatch;
+    const auto operations = std::make_shared<const ir::Program>(std::move(program));
+    auto compiler = BytecodeCompiler<Cell>{.GuardSize = context.GuardSize, .Profile = context.Profile};
+    const auto code = std::make_shared<const Bytecode>(compiler.Compile(*operations));
+    if (context.Statistics)
+    {
+        context.Statistics->EmitSeconds += emitStopwatch.ElapsedSeconds();
+    }
+
+    return [operations, code](CharPtr begin, CharPtr end, OutputBuffer *output, InputBuffer *input) {
+        return Execute<Cell>(*code, begin, end, output, input);
+    };
+}
+} // namespace
+
+Entrypoint Interpreter::Compile(const CompilerContext &context)
+{
+    if (!context.Reader)
+    {
+        throw Exception("instruction reader must not be null");
+    }
+
+    return DispatchCellBits(context.CellBits, [&](auto cell) { return CompileProgram<decltype(cell)>(context); });
+}
@@ -0,0 +1,17 @@
+#ifndef BFJIT_INTERPRETER_HPP
+#define BFJIT_INTERPRETER_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+// Runs the optimized program as threaded bytecode instead of generating machine code, which makes it start up
+// immediately at the cost of throughput.
+class Interpreter final : public CompilerBackend
+{
+public:
+    Entrypoint Compile(const CompilerContext &context) override;
+};
+} // namespace bfjit
+
+#endif // BFJIT_INTERPRETER_HPP
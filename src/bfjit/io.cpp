@@ -0,0 +1,224 @@
+#include "io.hpp"
+#include "exception.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace bfjit;
+
+Result bfjit::WriteOutput(OutputBuffer *output, const CharType *data, UInt64 size)
+{
+    assert(output);
+
+    while (size)
+    {
+        if (output->Cursor == output->Limit)
+        {
+            const auto result = output->Flush(output);
+            if (result != Result::Success)
+            {
+                return result;
+            }
+        }
+
+        const auto count = std::min(size, static_cast<UInt64>(output->Limit - output->Cursor));
+        std::memcpy(output->Cursor, data, count);
+        output->Cursor += count;
+        data += count;
+        size -= count;
+    }
+
+    return Result::Success;
+}
+
+FileOutputBuffer::FileOutputBuffer(int fd, std::size_t capacity) : OutputBuffer{}, m_fd(fd), m_storage(capacity)
+{
+    assert(capacity);
+
+    Cursor = m_storage.data();
+    Limit = m_storage.data() + m_storage.size();
+    Flush = FlushBuffer;
+}
+
+Result FileOutputBuffer::FlushAll()
+{
+    auto first = m_storage.data();
+    while (first != Cursor)
+    {
+        const auto written = write(m_fd, first, Cursor - first);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            // Whatever couldn't be written is dropped, so that a program ignoring the error can keep going.
+            Cursor = m_storage.data();
+            return Result::WriteError;
+        }
+
+        first += written;
+    }
+
+    Cursor = m_storage.data();
+    return Result::Success;
+}
+
+Result FileOutputBuffer::FlushBuffer(OutputBuffer *buffer)
+{
+    assert(buffer);
+
+    return static_cast<FileOutputBuffer *>(buffer)->FlushAll();
+}
+
+FileInputBuffer::FileInputBuffer(int fd, OutputBuffer *tiedOutput, std::size_t capacity)
+    : InputBuffer{}, m_fd(fd), m_tiedOutput(tiedOutput)
+{
+    assert(capacity);
+
+    Refill = RefillBuffer;
+
+    struct stat status = {};
+    const auto position = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && position >= 0 && status.st_size > position)
+    {
+        const auto size = static_cast<std::size_t>(status.st_size);
+        const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            m_mapping = static_cast<CharPtr>(mapping);
+            m_mappingSize = size;
+            Cursor = m_mapping + position;
+            Limit = m_mapping + size;
+            return;
+        }
+    }
+
+    m_storage.resize(capacity);
+    Cursor = m_storage.data();
+    Limit = m_storage.data();
+}
+
+FileInputBuffer::~FileInputBuffer()
+{
+    if (m_mapping)
+    {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
+
+Result FileInputBuffer::ReadMore()
+{
+    if (m_mapping)
+    {
+        return Result::ReadError;
+    }
+
+    // Nothing waits on a mapped file, while a read may block until the output written so far is answered.
+    if (m_tiedOutput)
+    {
+        const auto result = m_tiedOutput->Flush(m_tiedOutput);
+        if (result != Result::Success)
+        {
+            return result;
+        }
+    }
+
+    while (true)
+    {
+        const auto count = read(m_fd, m_storage.data(), m_storage.size());
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return Result::ReadError;
+        }
+
+        Cursor = m_storage.data();
+        Limit = m_storage.data() + count;
+        return Result::Success;
+    }
+}
+
+Result FileInputBuffer::RefillBuffer(InputBuffer *buffer)
+{
+    assert(buffer);
+
+    return static_cast<FileInputBuffer *>(buffer)->ReadMore();
+}
+
+SourceFile::SourceFile(const String &fileName)
+{
+    const auto fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw Exception::Formatted("failed to open source file {}: {}", fileName, std::strerror(errno));
+    }
+
+    struct stat status = {};
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+    {
+        const auto size = static_cast<std::size_t>(status.st_size);
+        const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            m_mapping = static_cast<CharPtr>(mapping);
+            m_mappingSize = size;
+            close(fd);
+            return;
+        }
+    }
+
+    // Pipes and the like can't be mapped, and neither can empty files.
+    CharType chunk[1 << 16];
+    while (true)
+    {
+        const auto count = read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count < 0)
+        {
+            const auto error = errno;
+            close(fd);
+            throw Exception::Formatted("failed to read source file {}: {}", fileName, std::strerror(error));
+        }
+
+        if (count == 0)
+        {
+            break;
+        }
+
+        m_storage.insert(m_storage.end(), chunk, chunk + count);
+    }
+
+    close(fd);
+}
+
+SourceFile::~SourceFile()
+{
+    if (m_mapping)
+    {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
+
+StringRef SourceFile::Text() const noexcept
+{
+    return m_mapping ? StringRef(m_mapping, m_mappingSize) : StringRef(m_storage.data(), m_storage.size());
+}
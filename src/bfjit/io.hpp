@@ -0,0 +1,77 @@
+#ifndef BFJIT_IO_HPP
+#define BFJIT_IO_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+// Writes `size` bytes out through `output`, flushing it whenever it fills up.
+Result WriteOutput(OutputBuffer *output, const CharType *data, UInt64 size);
+
+// Collects the program output and writes it to a file descriptor in large chunks.
+class FileOutputBuffer final : public OutputBuffer
+{
+public:
+    explicit FileOutputBuffer(int fd, std::size_t capacity = 1 << 16);
+
+    FileOutputBuffer(const FileOutputBuffer &) = delete;
+
+    FileOutputBuffer &operator=(const FileOutputBuffer &) = delete;
+
+    Result FlushAll();
+
+private:
+    static Result FlushBuffer(OutputBuffer *buffer);
+
+    int m_fd;
+    Vector<CharType> m_storage;
+};
+
+// Provides the program input read from a file descriptor in large chunks, or mapped into memory at once when the
+// descriptor refers to a regular file. The `tiedOutput` buffer is flushed before every read, so that a prompt shows up
+// before the program waits for the answer to it.
+class FileInputBuffer final : public InputBuffer
+{
+public:
+    explicit FileInputBuffer(int fd, OutputBuffer *tiedOutput = nullptr, std::size_t capacity = 1 << 16);
+
+    FileInputBuffer(const FileInputBuffer &) = delete;
+
+    FileInputBuffer &operator=(const FileInputBuffer &) = delete;
+
+    ~FileInputBuffer();
+
+    Result ReadMore();
+
+private:
+    static Result RefillBuffer(InputBuffer *buffer);
+
+    int m_fd;
+    OutputBuffer *m_tiedOutput;
+    Vector<CharType> m_storage;
+    CharPtr m_mapping = nullptr;
+    std::size_t m_mappingSize = 0;
+};
+
+// The contents of a source file, mapped into memory when it's a regular file and read otherwise.
+class SourceFile
+{
+public:
+    explicit SourceFile(const String &fileName);
+
+    SourceFile(const SourceFile &) = delete;
+
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    ~SourceFile();
+
+    StringRef Text() const noexcept;
+
+private:
+    Vector<CharType> m_storage;
+    CharPtr m_mapping = nullptr;
+    std::size_t m_mappingSize = 0;
+};
+} // namespace bfjit
+
+#endif // BFJIT_IO_HPP
@@ -0,0 +1,431 @@
+#include "ir.hpp"
+#include "cell.hpp"
+#include "exception.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <map>
+
+using namespace bfjit;
+using namespace bfjit::ir;
+
+namespace
+{
+using Pass = void (*)(Program &);
+
+template <typename Cell> constexpr inline std::array Passes = {
+    static_cast<Pass>(FoldRuns),
+    static_cast<Pass>(LowerMultiplyLoops<Cell>),
+    static_cast<Pass>(LowerScanLoops),
+    static_cast<Pass>(FoldRuns),
+    static_cast<Pass>(RemoveDeadLoops),
+    // Removing a loop leaves the moves around it next to each other.
+    static_cast<Pass>(FoldRuns),
+    static_cast<Pass>(DeferPointerMoves),
+};
+
+Boolean IsFoldable(OperationKind kind) noexcept
+{
+    return kind == OperationKind::AddCell || kind == OperationKind::MovePtr;
+}
+
+Boolean IsLoop(OperationKind kind) noexcept
+{
+    return kind == OperationKind::Loop || kind == OperationKind::MultiplyLoop || kind == OperationKind::ScanLoop;
+}
+
+Boolean IsCellWrite(OperationKind kind) noexcept
+{
+    return kind == OperationKind::AddCell || kind == OperationKind::SetCell;
+}
+
+Boolean LeavesCellZero(const Operation &operation) noexcept
+{
+    return IsLoop(operation.Kind) || (operation.Kind == OperationKind::SetCell && operation.Value == 0);
+}
+
+template <typename Cell> Optional<Operation> TryLowerMultiplyLoop(const Program &body)
+{
+    // Every position the body visits is followed by an `AddCell`, since runs of moves are folded, so keeping the
+    // entries that add nothing preserves the range of cells the loop would touch.
+    std::map<Int64, Int64> deltas;
+    Int64 offset = 0;
+    for (const auto &operation : body)
+    {
+        switch (operation.Kind)
+        {
+        case OperationKind::AddCell:
+            deltas[offset] += operation.Value;
+            break;
+        case OperationKind::MovePtr:
+            offset += operation.Value;
+            break;
+        default:
+            return {};
+        }
+    }
+
+    using Value = typename Cell::Value;
+    const auto step = static_cast<Value>(deltas[0]);
+    if (offset != 0 || (step != 1 && step != std::numeric_limits<Value>::max()))
+    {
+        return {};
+    }
+
+    // A loop decrementing the counter runs `cell` times, while an incrementing one runs `-cell` times.
+    const auto sign = step == 1 ? -1 : 1;
+    deltas.erase(0);
+    if (deltas.empty())
+    {
+        return Operation{.Kind = OperationKind::SetCell, .Value = 0};
+    }
+
+    // The range the loop touches is checked at once, which has to report the end the loop would have run off first.
+    auto result = Operation{.Kind = OperationKind::MultiplyLoop};
+    offset = 0;
+    for (const auto &operation : body)
+    {
+        offset += operation.Kind == OperationKind::MovePtr ? operation.Value : 0;
+        if (offset == deltas.begin()->first || offset == deltas.rbegin()->first)
+        {
+            result.Value = offset;
+            break;
+        }
+    }
+
+    for (const auto &[target, delta] : deltas)
+    {
+        result.Body.push_back(
+            Operation{.Kind = OperationKind::MultiplyAdd, .Value = sign * delta, .Offset = target});
+    }
+
+    return result;
+}
+
+void RemoveLoopsAfterLoops(Program &program)
+{
+    Program result;
+    result.reserve(program.size());
+
+    for (auto &operation : program)
+    {
+        if (IsLoop(operation.Kind))
+        {
+            // The cell is known to be zero right after a loop or a clear, so the following loop never runs.
+            if (!result.empty() && LeavesCellZero(result.back()))
+            {
+                continue;
+            }
+
+            if (operation.Kind == OperationKind::Loop)
+            {
+                RemoveLoopsAfterLoops(operation.Body);
+            }
+        }
+
+        result.push_back(std::move(operation));
+    }
+
+    program = std::move(result);
+}
+} // namespace
+
+Program ir::BuildProgram(InstructionReader &reader)
+{
+    Vector<Program> scopes(1);
+    Vector<Int64> openPositions;
+
+    for (Int64 position = 0;; ++position)
+    {
+        const auto instruction = reader.Next();
+        switch (instruction)
+        {
+        case Instruction::Inc:
+            scopes.back().push_back(Operation{.Kind = OperationKind::AddCell, .Value = 1});
+            break;
+        case Instruction::Dec:
+            scopes.back().push_back(Operation{.Kind = OperationKind::AddCell, .Value = -1});
+            break;
+        case Instruction::Next:
+            scopes.back().push_back(Operation{.Kind = OperationKind::MovePtr, .Value = 1});
+            break;
+        case Instruction::Prev:
+            scopes.back().push_back(Operation{.Kind = OperationKind::MovePtr, .Value = -1});
+            break;
+        case Instruction::Jz:
+            scopes.emplace_back();
+            openPositions.push_back(position);
+            break;
+        case Instruction::Jnz: {
+            if (scopes.size() == 1)
+            {
+                throw Exception("no matching open label found");
+            }
+
+            auto body = std::move(scopes.back());
+            scopes.pop_back();
+            scopes.back().push_back(
+                Operation{.Kind = OperationKind::Loop, .Body = std::move(body), .Position = openPositions.back()});
+            openPositions.pop_back();
+            break;
+        }
+        case Instruction::WriteChar:
+            scopes.back().push_back(Operation{.Kind = OperationKind::WriteChar});
+            break;
+        case Instruction::ReadChar:
+            scopes.back().push_back(Operation{.Kind = OperationKind::ReadChar});
+            break;
+        case Instruction::Invalid:
+            if (scopes.size() != 1)
+            {
+                throw Exception("no matching close label found");
+            }
+
+            return std::move(scopes.front());
+        }
+    }
+}
+
+void ir::FoldRuns(Program &program)
+{
+    Program result;
+    result.reserve(program.size());
+
+    for (auto &operation : program)
+    {
+        if (operation.Kind == OperationKind::Loop)
+        {
+            FoldRuns(operation.Body);
+        }
+
+        if (!result.empty())
+        {
+            auto &previous = result.back();
+            if (IsFoldable(operation.Kind) && previous.Kind == operation.Kind)
+            {
+                // Merging may cancel the previous operation out, which in turn exposes the one before it, so
+                // `>+-<` folds away completely.
+                previous.Value += operation.Value;
+                if (previous.Value == 0)
+                {
+                    result.pop_back();
+                }
+
+                continue;
+            }
+
+            if (operation.Kind == OperationKind::AddCell && previous.Kind == OperationKind::SetCell)
+            {
+                previous.Value += operation.Value;
+                continue;
+            }
+        }
+
+        if (operation.Kind == OperationKind::SetCell)
+        {
+            while (!result.empty() && IsCellWrite(result.back().Kind))
+            {
+                result.pop_back();
+            }
+        }
+
+        if (!IsFoldable(operation.Kind) || operation.Value != 0)
+        {
+            result.push_back(std::move(operation));
+        }
+    }
+
+    program = std::move(result);
+}
+
+template <typename Cell> void ir::LowerMultiplyLoops(Program &program)
+{
+    for (auto &operation : program)
+    {
+        if (operation.Kind != OperationKind::Loop)
+        {
+            continue;
+        }
+
+        LowerMultiplyLoops<Cell>(operation.Body);
+        if (auto lowered = TryLowerMultiplyLoop<Cell>(operation.Body))
+        {
+            lowered->Position = operation.Position;
+            operation = std::move(*lowered);
+        }
+    }
+}
+
+void ir::LowerScanLoops(Program &program)
+{
+    for (auto &operation : program)
+    {
+        if (operation.Kind != OperationKind::Loop)
+        {
+            continue;
+        }
+
+        auto &body = operation.Body;
+        if (body.size() == 1 && body.front().Kind == OperationKind::MovePtr)
+        {
+            operation = Operation{
+                .Kind = OperationKind::ScanLoop,
+                .Value = body.front().Value,
+                .Position = operation.Position,
+            };
+        }
+        else
+        {
+            LowerScanLoops(body);
+        }
+    }
+}
+
+void ir::RemoveDeadLoops(Program &program)
+{
+    // The tape starts zeroed, so loops preceding any cell modification (typically comment blocks) never run.
+    auto first = program.begin();
+    while (first != program.end() && !IsCellWrite(first->Kind) && first->Kind != OperationKind::ReadChar)
+    {
+        if (IsLoop(first->Kind))
+        {
+            first = program.erase(first);
+        }
+        else
+        {
+            ++first;
+        }
+    }
+
+    RemoveLoopsAfterLoops(program);
+}
+
+void ir::DeferPointerMoves(Program &program)
+{
+    Program result;
+    Int64 offset = 0;
+    const auto commit = [&] {
+        if (offset)
+        {
+            result.push_back(Operation{.Kind = OperationKind::MovePtr, .Value = offset});
+            offset = 0;
+        }
+    };
+
+    for (auto &operation : program)
+    {
+        switch (operation.Kind)
+        {
+        case OperationKind::MovePtr:
+            offset += operation.Value;
+            break;
+        case OperationKind::AddCell:
+        case OperationKind::SetCell:
+        case OperationKind::WriteChar:
+        case OperationKind::ReadChar:
+            operation.Offset += offset;
+            result.push_back(std::move(operation));
+            break;
+        default:
+            if (operation.Kind == OperationKind::Loop)
+            {
+                DeferPointerMoves(operation.Body);
+            }
+            commit();
+            result.push_back(std::move(operation));
+            break;
+        }
+    }
+
+    // Loops test the cell the pointer is left at.
+    commit();
+    program = std::move(result);
+}
+
+template <typename Cell> void ir::Optimize(Program &program)
+{
+    for (const auto pass : Passes<Cell>)
+    {
+        pass(program);
+    }
+}
+
+// Reading input may end the program, and a nested loop may never finish, so nothing after either of them is certain
+// to run, and output written before an access fails has to come out. Multiply loops always finish. The end of the range
+// is checked before its start, so the range stops growing forward once it has grown backward, to report the error the
+// first access off the tape would.
+ir::LoopRange ir::AnalyzeLoopRange(const Operation &loop)
+{
+    assert(loop.Kind == OperationKind::Loop);
+
+    LoopRange range;
+    Int64 offset = 0;
+    Boolean isCertain = true;
+    const auto access = [&](Int64 cell) {
+        if (isCertain && cell > range.MaxOffset && range.MinOffset < 0)
+        {
+            isCertain = false;
+        }
+
+        if (isCertain)
+        {
+            range.MinOffset = std::min(range.MinOffset, cell);
+            range.MaxOffset = std::max(range.MaxOffset, cell);
+        }
+    };
+
+    for (const auto &operation : loop.Body)
+    {
+        switch (operation.Kind)
+        {
+        case OperationKind::AddCell:
+        case OperationKind::SetCell:
+            access(offset + operation.Offset);
+            break;
+        case OperationKind::WriteChar:
+        case OperationKind::ReadChar:
+            access(offset + operation.Offset);
+            isCertain = false;
+            break;
+        case OperationKind::MovePtr:
+            offset += operation.Value;
+            break;
+        case OperationKind::Loop:
+            access(offset);
+            isCertain = false;
+            if (!AnalyzeLoopRange(operation).IsBalanced)
+            {
+                return range;
+            }
+            break;
+        case OperationKind::MultiplyLoop:
+            access(offset);
+            break;
+        case OperationKind::ScanLoop:
+            access(offset);
+            return range;
+        case OperationKind::MultiplyAdd:
+        case OperationKind::StoreBlock:
+        case OperationKind::WriteBlock:
+            assert(false);
+            return range;
+        }
+    }
+
+    access(offset);
+    range.IsBalanced = offset == 0;
+    return range;
+}
+
+template void ir::LowerMultiplyLoops<Cell8>(Program &program);
+template void ir::LowerMultiplyLoops<Cell16>(Program &program);
+template void ir::LowerMultiplyLoops<Cell32>(Program &program);
+template void ir::LowerMultiplyLoops<Cell64>(Program &program);
+
+template void ir::Optimize<Cell8>(Program &program);
+template void ir::Optimize<Cell16>(Program &program);
+template void ir::Optimize<Cell32>(Program &program);
+template void ir::Optimize<Cell64>(Program &program);
@@ -0,0 +1,77 @@
+#ifndef BFJIT_IR_HPP
+#define BFJIT_IR_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+namespace ir
+{
+enum class OperationKind
+{
+    AddCell,
+    SetCell,
+    MovePtr,
+    Loop,
+    MultiplyLoop,
+    MultiplyAdd,
+    ScanLoop,
+    WriteChar,
+    ReadChar,
+    StoreBlock,
+    WriteBlock,
+};
+
+// `AddCell`, `SetCell`, `WriteChar` and `ReadChar` act on the cell `Offset` cells away from the current one.
+// `MultiplyLoop` is a loop whose body only consists of `MultiplyAdd` operations adding `Value` times the current cell
+// to the cell at `Offset`; the current cell is cleared afterwards. Its targets are sorted by offset, and its own
+// `Value` is the offset of whichever of the first and the last of them the original loop visited first. `ScanLoop`
+// moves the pointer by `Value` until it reaches a zero cell. Loops of every kind keep the `Position` of their opening
+// instruction in the instruction stream. `StoreBlock` checks that the `Value` cells starting at the current one are on
+// the tape, even when `Data` is empty, and copies `Data` over the first of them, while `WriteBlock` writes `Data` out;
+// both only ever start a program.
+struct Operation
+{
+    OperationKind Kind;
+    Int64 Value = 0;
+    Int64 Offset = 0;
+    Vector<Operation> Body;
+    Int64 Position = 0;
+    Vector<CharType> Data;
+};
+
+using Program = Vector<Operation>;
+
+Program BuildProgram(InstructionReader &reader);
+
+void FoldRuns(Program &program);
+
+// The counter of a multiply loop has to reach zero modulo the cell size, which the cell policy `Cell` tells.
+template <typename Cell> void LowerMultiplyLoops(Program &program);
+
+void LowerScanLoops(Program &program);
+
+void RemoveDeadLoops(Program &program);
+
+// Addresses the cells accessed by every run of operations between loops relative to where the run starts, replacing
+// the moves within it with a single one at its end. Has to come last, as other passes assume a zero `Offset`. Offsets
+// already assigned are kept, so running it again only folds the moves added since.
+void DeferPointerMoves(Program &program);
+
+template <typename Cell> void Optimize(Program &program);
+
+// Every iteration of a loop accesses the cells from `MinOffset` to `MaxOffset` relative to the one it starts at
+// before writing or reading a character or running a nested loop. Balanced loops end every iteration at the cell they
+// started it at.
+struct LoopRange
+{
+    Int64 MinOffset = 0;
+    Int64 MaxOffset = 0;
+    Boolean IsBalanced = false;
+};
+
+LoopRange AnalyzeLoopRange(const Operation &loop);
+} // namespace ir
+} // namespace bfjit
+
+#endif // BFJIT_IR_HPP
@@ -0,0 +1,119 @@
+#include "lexer.hpp"
+
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BFJIT_LEXER_SIMD 1
+#endif
+
+using namespace bfjit;
+
+namespace
+{
+constexpr std::array<Instruction, 256> MakeInstructionTable() noexcept
+{
+    std::array<Instruction, 256> table = {};
+    table['+'] = Instruction::Inc;
+    table['-'] = Instruction::Dec;
+    table['>'] = Instruction::Next;
+    table['<'] = Instruction::Prev;
+    table['['] = Instruction::Jz;
+    table[']'] = Instruction::Jnz;
+    table['.'] = Instruction::WriteChar;
+    table[','] = Instruction::ReadChar;
+    return table;
+}
+
+constexpr inline auto InstructionTable = MakeInstructionTable();
+
+using LexFunc = Instruction *(*)(const CharType *, const CharType *, Instruction *);
+
+Instruction *LexScalar(const CharType *current, const CharType *end, Instruction *output)
+{
+    for (; current != end; ++current)
+    {
+        const auto instruction = InstructionTable[static_cast<unsigned char>(*current)];
+        *output = instruction;
+        output += instruction != Instruction::Invalid;
+    }
+
+    return output;
+}
+
+#ifdef BFJIT_LEXER_SIMD
+// `+,-.` are adjacent in ASCII, so a single range check covers half of the commands.
+struct Sse2Block
+{
+    static constexpr std::ptrdiff_t Width = 16;
+
+    static UInt32 CommandMask(const CharType *data)
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        const auto shifted = _mm_sub_epi8(block, _mm_set1_epi8('+'));
+        auto commands = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(3)), shifted);
+        commands = _mm_or_si128(commands, _mm_cmpeq_epi8(block, _mm_set1_epi8('<')));
+        commands = _mm_or_si128(commands, _mm_cmpeq_epi8(block, _mm_set1_epi8('>')));
+        commands = _mm_or_si128(commands, _mm_cmpeq_epi8(block, _mm_set1_epi8('[')));
+        commands = _mm_or_si128(commands, _mm_cmpeq_epi8(block, _mm_set1_epi8(']')));
+        return static_cast<UInt32>(_mm_movemask_epi8(commands));
+    }
+};
+
+struct Avx2Block
+{
+    static constexpr std::ptrdiff_t Width = 32;
+
+    [[gnu::target("avx2")]] static UInt32 CommandMask(const CharType *data)
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        const auto shifted = _mm256_sub_epi8(block, _mm256_set1_epi8('+'));
+        auto commands = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(3)), shifted);
+        commands = _mm256_or_si256(commands, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('<')));
+        commands = _mm256_or_si256(commands, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('>')));
+        commands = _mm256_or_si256(commands, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('[')));
+        commands = _mm256_or_si256(commands, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(']')));
+        return static_cast<UInt32>(_mm256_movemask_epi8(commands));
+    }
+};
+
+// Blocks without commands are skipped as a whole, and only the command bytes of the others are looked up.
+template <typename Block> Instruction *LexBlocks(const CharType *current, const CharType *end, Instruction *output)
+{
+    for (; end - current >= Block::Width; current += Block::Width)
+    {
+        for (auto mask = Block::CommandMask(current); mask; mask &= mask - 1)
+        {
+            *output++ = InstructionTable[static_cast<unsigned char>(current[__builtin_ctz(mask)])];
+        }
+    }
+
+    return LexScalar(current, end, output);
+}
+
+Instruction *LexSse2(const CharType *current, const CharType *end, Instruction *output)
+{
+    return LexBlocks<Sse2Block>(current, end, output);
+}
+
+[[gnu::target("avx2"), gnu::flatten]] Instruction *LexAvx2(const CharType *current, const CharType *end,
+                                                            Instruction *output)
+{
+    return LexBlocks<Avx2Block>(current, end, output);
+}
+
+const LexFunc Lex = __builtin_cpu_supports("avx2") ? LexAvx2 : LexSse2;
+#else
+const LexFunc Lex = LexScalar;
+#endif
+} // namespace
+
+Vector<Instruction> bfjit::LexInstructions(StringRef source)
+{
+    // There can't be more instructions than characters; the excess is trimmed afterwards.
+    Vector<Instruction> instructions(source.size());
+    const auto last = Lex(source.data(), source.data() + source.size(), instructions.data());
+    instructions.resize(last - instructions.data());
+
+    return instructions;
+}
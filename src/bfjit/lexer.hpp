@@ -0,0 +1,12 @@
+#ifndef BFJIT_LEXER_HPP
+#define BFJIT_LEXER_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+// Translates the command characters of `source` into instructions, dropping everything else.
+Vector<Instruction> LexInstructions(StringRef source);
+} // namespace bfjit
+
+#endif // BFJIT_LEXER_HPP
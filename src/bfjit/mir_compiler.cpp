@@ -1,10 +1,23 @@
 #include "mir_compiler.hpp"
+#include "cache.hpp"
+#include "cell.hpp"
 #include "exception.hpp"
-
+#include "io.hpp"
+#include "ir.hpp"
+#include "prefix.hpp"
+#include "profile.hpp"
+#include "scan.hpp"
+#include "statistics.hpp"
+
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
-#include <stack>
+#include <cstring>
+#include <unordered_map>
 
 extern "C"
 {
@@ -18,16 +31,64 @@ namespace
 {
 constexpr inline auto BeginArgName = "begin";
 constexpr inline auto EndArgName = "end";
+constexpr inline auto OutputArgName = "output";
+constexpr inline auto InputArgName = "input";
 constexpr inline auto CurrentPtrArgName = "current";
+constexpr inline auto CellRegName = "cell";
 constexpr inline auto MainFuncName = "main";
-constexpr inline auto ReadCharFuncName = "readChar";
-constexpr inline auto WriteCharFuncName = "writeChar";
+constexpr inline auto LoopFuncName = "loop";
+constexpr inline auto RefillInputFuncName = "refillInput";
+constexpr inline auto FlushOutputFuncName = "flushOutput";
+constexpr inline auto ScanFuncName = "scan";
+constexpr inline auto CopyFuncName = "copy";
+constexpr inline auto CopyImportName = "bfjit_copy";
+constexpr inline auto WriteBlockFuncName = "writeBlock";
+constexpr inline auto WriteBlockImportName = "bfjit_write_output";
+constexpr inline auto PromoteLoopFuncName = "promoteLoop";
 constexpr inline auto ModuleName = "bfjit";
 
-struct LabelPair
+// Returned by tier 0 loop functions which want to be replaced by optimized code before running any further. Lies
+// outside of the `Result` range.
+constexpr inline Int64 TierUpStatus = 0x100;
+constexpr inline UInt32 TierUpOptimizationLevel = 3;
+
+// Bumped whenever the generated code changes, so that stale cache entries are never loaded.
+constexpr inline UInt32 CacheFormatVersion = 4;
+
+// How cells of a given width are accessed by the generated code: the memory type they're loaded and stored as, the
+// instruction truncating a register to the cell width, and the runtime scan kernels working on them.
+template <typename Cell> struct MirCell;
+
+template <> struct MirCell<Cell8>
+{
+    static constexpr MIR_type_t Type = MIR_T_U8;
+    static constexpr MIR_insn_code_t Extension = MIR_UEXT8;
+    static constexpr auto ScanForwardFuncName = "bfjit_scan_forward_8";
+    static constexpr auto ScanBackwardFuncName = "bfjit_scan_backward_8";
+};
+
+template <> struct MirCell<Cell16>
+{
+    static constexpr MIR_type_t Type = MIR_T_U16;
+    static constexpr MIR_insn_code_t Extension = MIR_UEXT16;
+    static constexpr auto ScanForwardFuncName = "bfjit_scan_forward_16";
+    static constexpr auto ScanBackwardFuncName = "bfjit_scan_backward_16";
+};
+
+template <> struct MirCell<Cell32>
+{
+    static constexpr MIR_type_t Type = MIR_T_U32;
+    static constexpr MIR_insn_code_t Extension = MIR_UEXT32;
+    static constexpr auto ScanForwardFuncName = "bfjit_scan_forward_32";
+    static constexpr auto ScanBackwardFuncName = "bfjit_scan_backward_32";
+};
+
+// Registers are as wide as the cells, so they never need truncating.
+template <> struct MirCell<Cell64>
 {
-    MIR_label_t OpenLabel;
-    MIR_label_t CloseLabel;
+    static constexpr MIR_type_t Type = MIR_T_U64;
+    static constexpr auto ScanForwardFuncName = "bfjit_scan_forward_64";
+    static constexpr auto ScanBackwardFuncName = "bfjit_scan_backward_64";
 };
 
 struct Argument
@@ -40,6 +101,20 @@ struct Argument
     }
 };
 
+// Replaces the default handler, which exits the process. mir is built with `-fexceptions`, so the exception unwinds
+// through it, but the context it's thrown out of may be left half way through an update. Errors raised on the
+// generator threads still end the process, as there's nothing to catch them there.
+[[noreturn]] void ThrowMirError(MIR_error_type_t, const char *format, ...)
+{
+    std::array<char, 512> message = {};
+    va_list arguments;
+    va_start(arguments, format);
+    std::vsnprintf(message.data(), message.size(), format, arguments);
+    va_end(arguments);
+
+    throw Exception::Formatted("mir error: {}", message.data());
+}
+
 template <typename... Types> auto MakeResultTypes(const Types &...types)
 {
     return std::array<MIR_type_t, sizeof...(Types)>{types...};
@@ -57,44 +132,323 @@ template <typename... Types> auto MakeArguments(const Types &...types)
     return std::array<MIR_var_t, sizeof...(Types)>{GetType(types)...};
 }
 
-struct CompilationUnit
+auto MakeLoopArguments()
+{
+    return MakeArguments(Argument(BeginArgName, MIR_T_I64), Argument(EndArgName, MIR_T_I64),
+                         Argument(CurrentPtrArgName, MIR_T_I64), Argument(OutputArgName, MIR_T_I64),
+                         Argument(InputArgName, MIR_T_I64));
+}
+
+// The state shared by the tier 0 code of a program and the loops promoted later on. Every loop of the program is
+// called through `Entries`, which initially points to its tier 0 function, and the back edges of tier 0 loops count
+// iterations in `Counters`.
+struct TieredProgram
+{
+    MIR_context_t Mir;
+    ir::Program Program;
+    UInt32 GuardSize = 0;
+    UInt32 CellBits = 8;
+    UInt32 TierUpThreshold = 0;
+    Vector<const ir::Operation *> Loops;
+    std::unordered_map<const ir::Operation *, std::size_t> LoopIndices;
+    Vector<void *> Entries;
+    Vector<std::uint64_t> Counters;
+    Boolean IsFailed = false;
+
+    TieredProgram(MIR_context_t mir, ir::Program program, UInt32 guardSize, UInt32 cellBits, UInt32 tierUpThreshold)
+        : Mir(mir), Program(std::move(program)), GuardSize(guardSize), CellBits(cellBits),
+          TierUpThreshold(tierUpThreshold)
+    {
+        CollectLoops(Program);
+        Entries.resize(Loops.size());
+        Counters.resize(Loops.size());
+    }
+
+    void CollectLoops(const ir::Program &operations)
+    {
+        for (const auto &operation : operations)
+        {
+            if (operation.Kind == ir::OperationKind::Loop)
+            {
+                LoopIndices.emplace(&operation, Loops.size());
+                Loops.push_back(&operation);
+                CollectLoops(operation.Body);
+            }
+        }
+    }
+
+    std::size_t LoopIndex(const ir::Operation &loop) const
+    {
+        const auto index = LoopIndices.find(&loop);
+        assert(index != LoopIndices.end());
+
+        return index->second;
+    }
+
+    void Promote(std::size_t index);
+
+    // Called by the generated code. A loop which fails to compile keeps running its tier 0 code, and so do the ones
+    // that would be promoted after it, since the failure may leave the context half way through an update.
+    static void PromoteLoop(TieredProgram *program, Int64 index) noexcept
+    {
+        assert(program);
+
+        if (program->IsFailed)
+        {
+            return;
+        }
+
+        try
+        {
+            program->Promote(static_cast<std::size_t>(index));
+        }
+        catch (...)
+        {
+            program->IsFailed = true;
+        }
+    }
+};
+
+// Pointer moves and offsets are counted in cells, and scaled to bytes as they're emitted.
+template <typename Cell> struct CompilationUnit
 {
     MIR_context_t Mir;
-    WriteCharFunc WriteChar;
-    ReadCharFunc ReadChar;
-    InstructionReader &Reader;
-    std::stack<LabelPair> Labels;
+    UInt32 GuardSize = 0;
+    // Loops are emitted as calls to separate functions when compiling tier 0 code, and inline otherwise.
+    TieredProgram *Tiered = nullptr;
+    // Otherwise, loops made of at least this many operations, not counting the loops outlined within them, get a
+    // function of their own, which keeps the functions the generator works on small. Zero disables outlining.
+    UInt32 OutlineThreshold = 0;
+    // Functions are generated once they're first called rather than when they're loaded.
+    Boolean Lazy = false;
+    CompilerStatistics *Statistics = nullptr;
+    LoopProfile *Profile = nullptr;
+    std::size_t NextProfiledLoop = 0;
     MIR_item_t FuncItem = nullptr;
+    Boolean IsLoopFunction = false;
+    const ir::Operation *OutlinedLoop = nullptr;
     MIR_reg_t BeginArgReg = 0;
     MIR_reg_t EndArgReg = 0;
+    MIR_reg_t OutputArgReg = 0;
+    MIR_reg_t InputArgReg = 0;
     MIR_reg_t CurrentPtrReg = 0;
+    MIR_reg_t CellReg = 0;
+    Boolean IsCellCached = false;
+    Boolean IsCellDirty = false;
+    Boolean IsCellNormalized = false;
+    // The cell cached in `CellReg` is this many cells away from `CurrentPtrReg`.
+    Int64 CellOffset = 0;
+    // The cells from `KnownMinOffset` to `KnownMaxOffset` relative to the current one are on the tape, as a check or
+    // an access would have failed on the way here otherwise.
+    Int64 KnownMinOffset = 0;
+    Int64 KnownMaxOffset = 0;
     MIR_label_t OutOfMemoryErrorLabel = nullptr;
     MIR_label_t MemoryUnderrunErrorLabel = nullptr;
     std::uint32_t TempRegCounter = 0;
-    MIR_item_t WriteCharFuncProto = nullptr;
-    MIR_item_t ReadCharFuncProto = nullptr;
+    MIR_item_t FlushOutputFuncProto = nullptr;
+    MIR_item_t RefillInputFuncProto = nullptr;
+    MIR_item_t ScanFuncProto = nullptr;
+    MIR_item_t ScanForwardFuncImport = nullptr;
+    MIR_item_t ScanBackwardFuncImport = nullptr;
+    MIR_item_t CopyFuncProto = nullptr;
+    MIR_item_t CopyFuncImport = nullptr;
+    MIR_item_t WriteBlockFuncProto = nullptr;
+    MIR_item_t WriteBlockFuncImport = nullptr;
+    MIR_item_t LoopFuncProto = nullptr;
+    MIR_item_t PromoteLoopFuncProto = nullptr;
     MIR_module_t Module = nullptr;
+    Vector<MIR_item_t> LoopFuncItems;
+    std::unordered_map<const ir::Operation *, MIR_item_t> OutlinedFuncItems;
+    std::unordered_map<const ir::Operation *, MIR_item_t> BlockDataItems;
+
+    MainFunc Compile(const ir::Program &program)
+    {
+        return Load(EmitModule(program));
+    }
 
-    MainFunc Compile()
+    // Returns the main function of the finished module.
+    MIR_item_t EmitModule(const ir::Program &program)
     {
         assert(Mir);
-        assert(WriteChar);
-        assert(ReadChar);
 
-        BeginModule();
-        BeginFunction();
-        EmitInstructions();
-        EndFunction();
+        const Stopwatch stopwatch;
+        BeginModule(ModuleName);
+        EmitBlockData(program);
+
+        // Inner loops are outlined first, so that the functions calling them can refer to them.
+        if (!Tiered && OutlineThreshold)
+        {
+            Vector<const ir::Operation *> loops;
+            CollectOutlinedLoops(program, loops);
+            for (std::size_t index = 0; index < loops.size(); ++index)
+            {
+                const auto loopFuncItem = BeginLoopFunction(index);
+                OutlinedLoop = loops[index];
+                EmitLoopOperation(*loops[index]);
+                EndLoopFunction();
+                OutlinedFuncItems.emplace(loops[index], loopFuncItem);
+            }
+            OutlinedLoop = nullptr;
+        }
+
+        const auto mainFuncItem = BeginMainFunction();
+        EmitOperations(program);
+        EndMainFunction();
+
+        if (Tiered)
+        {
+            for (const auto loop : Tiered->Loops)
+            {
+                LoopFuncItems.push_back(BeginLoopFunction(Tiered->LoopIndex(*loop)));
+                OutlinedLoop = loop;
+                EmitLoopOperation(*loop);
+                EndLoopFunction();
+            }
+        }
+        EndModule();
+
+        if (Statistics)
+        {
+            Statistics->EmitSeconds += stopwatch.ElapsedSeconds();
+        }
+
+        return mainFuncItem;
+    }
+
+    // Linking generates every function of the module, spreading them over the generator threads, after which
+    // `MIR_gen` merely returns their code. Lazily linked functions are only generated by the thunks they're called
+    // through, hence the time spent on them and their size are only accounted for the code generated up front.
+    MainFunc Load(MIR_item_t mainFuncItem)
+    {
+        assert(mainFuncItem);
+
+        const Stopwatch loadStopwatch;
+        LoadModule();
+        if (Statistics)
+        {
+            Statistics->LoadSeconds += loadStopwatch.ElapsedSeconds();
+        }
+
+        const Stopwatch generateStopwatch;
+        const auto codeStart = _MIR_get_new_code_addr(Mir, 0);
+        MIR_link(Mir, Lazy ? MIR_set_lazy_gen_interface : MIR_set_parallel_gen_interface, nullptr);
+        const auto codeEnd = _MIR_get_new_code_addr(Mir, 0);
+        for (std::size_t index = 0; index < LoopFuncItems.size(); ++index)
+        {
+            Tiered->Entries[index] = FunctionAddress(LoopFuncItems[index]);
+        }
+        const auto entrypoint = reinterpret_cast<MainFunc>(FunctionAddress(mainFuncItem));
+        if (Statistics)
+        {
+            Statistics->GenerateSeconds += generateStopwatch.ElapsedSeconds();
+            // Machine code is laid out one function after another, so the growth of the code area tells its size
+            // unless a new area had to be started.
+            if (codeEnd > codeStart)
+            {
+                Statistics->CodeBytes += static_cast<UInt64>(codeEnd - codeStart);
+            }
+        }
+
+        return entrypoint;
+    }
+
+    void *FunctionAddress(MIR_item_t funcItem)
+    {
+        return Lazy ? funcItem->addr : MIR_gen(Mir, 0, funcItem);
+    }
+
+    // Blocks become data items of the module, which keeps them in cached modules. Like prototypes, data items can't
+    // be created while a function is being built.
+    void EmitBlockData(const ir::Program &program)
+    {
+        for (const auto &operation : program)
+        {
+            if ((operation.Kind == ir::OperationKind::StoreBlock || operation.Kind == ir::OperationKind::WriteBlock) &&
+                !operation.Data.empty())
+            {
+                char name[64];
+                std::snprintf(name, std::size(name), "block_%zu", BlockDataItems.size());
+                BlockDataItems.emplace(
+                    &operation, MIR_new_data(Mir, name, MIR_T_U8, operation.Data.size(), operation.Data.data()));
+            }
+        }
+    }
+
+    // Returns the number of operations left in `operations` once the loops to be outlined are replaced with calls,
+    // and appends those loops to `loops`, inner ones first.
+    std::size_t CollectOutlinedLoops(const ir::Program &operations, Vector<const ir::Operation *> &loops) const
+    {
+        std::size_t size = operations.size();
+        for (const auto &operation : operations)
+        {
+            if (operation.Kind != ir::OperationKind::Loop)
+            {
+                continue;
+            }
+
+            const auto bodySize = CollectOutlinedLoops(operation.Body, loops);
+            if (bodySize >= OutlineThreshold)
+            {
+                loops.push_back(&operation);
+            }
+            else
+            {
+                size += bodySize;
+            }
+        }
+
+        return size;
+    }
+
+    // Compiles a single loop into a function with the same signature as its tier 0 counterpart.
+    void *CompileLoop(const ir::Operation &loop, std::size_t index)
+    {
+        assert(Mir);
+        assert(!Tiered);
+
+        char moduleName[64];
+        std::snprintf(moduleName, std::size(moduleName), "%s_%s_%zu", ModuleName, LoopFuncName, index);
+        BeginModule(moduleName);
+        const auto loopFuncItem = BeginLoopFunction(index);
+        EmitLoopOperation(loop);
+        EndLoopFunction();
         EndModule();
 
-        return Link();
+        LoadModule();
+        MIR_link(Mir, MIR_set_gen_interface, nullptr);
+        return MIR_gen(Mir, 0, loopFuncItem);
     }
 
-    void BeginModule()
+    void BeginModule(const char *name)
     {
         assert(!Module);
 
-        Module = MIR_new_module(Mir, ModuleName);
+        Module = MIR_new_module(Mir, name);
+
+        // Prototypes can't be created while a function is being built.
+        RefillInputFuncProto = NewFunctionPrototype(RefillInputFuncName, MakeResultTypes(MIR_T_I64),
+                                                    MakeArguments(Argument("buffer", MIR_T_P)));
+        FlushOutputFuncProto = NewFunctionPrototype(FlushOutputFuncName, MakeResultTypes(MIR_T_I64),
+                                                    MakeArguments(Argument("buffer", MIR_T_P)));
+        ScanFuncProto = NewFunctionPrototype(
+            ScanFuncName, MakeResultTypes(MIR_T_P),
+            MakeArguments(Argument("ptr", MIR_T_P), Argument("limit", MIR_T_P), Argument("stride", MIR_T_I64)));
+        // Runtime functions are imported rather than called by address, which keeps modules free of addresses that
+        // only hold within this process.
+        ScanForwardFuncImport = MIR_new_import(Mir, MirCell<Cell>::ScanForwardFuncName);
+        ScanBackwardFuncImport = MIR_new_import(Mir, MirCell<Cell>::ScanBackwardFuncName);
+        CopyFuncProto = NewFunctionPrototype(
+            CopyFuncName, MakeResultTypes(MIR_T_P),
+            MakeArguments(Argument("target", MIR_T_P), Argument("source", MIR_T_P), Argument("size", MIR_T_I64)));
+        CopyFuncImport = MIR_new_import(Mir, CopyImportName);
+        WriteBlockFuncProto = NewFunctionPrototype(
+            WriteBlockFuncName, MakeResultTypes(MIR_T_I64),
+            MakeArguments(Argument("buffer", MIR_T_P), Argument("data", MIR_T_P), Argument("size", MIR_T_I64)));
+        WriteBlockFuncImport = MIR_new_import(Mir, WriteBlockImportName);
+        LoopFuncProto = NewFunctionPrototype(LoopFuncName, MakeResultTypes(MIR_T_I64, MIR_T_I64), MakeLoopArguments());
+        PromoteLoopFuncProto =
+            NewFunctionPrototype(PromoteLoopFuncName, MakeResultTypes(),
+                                 MakeArguments(Argument("program", MIR_T_P), Argument("index", MIR_T_I64)));
     }
 
     void EndModule()
@@ -104,53 +458,85 @@ struct CompilationUnit
         MIR_finish_module(Mir);
     }
 
-    MainFunc Link()
+    void LoadModule()
     {
         assert(Module);
-        assert(FuncItem);
 
         MIR_load_module(Mir, Module);
-        MIR_link(Mir, MIR_set_gen_interface, nullptr);
-        const auto entrypoint = MIR_gen(Mir, 0, FuncItem);
+        MIR_load_external(Mir, MirCell<Cell>::ScanForwardFuncName, reinterpret_cast<void *>(ScanForward<Cell>));
+        MIR_load_external(Mir, MirCell<Cell>::ScanBackwardFuncName, reinterpret_cast<void *>(ScanBackward<Cell>));
+        MIR_load_external(Mir, CopyImportName, reinterpret_cast<void *>(std::memcpy));
+        MIR_load_external(Mir, WriteBlockImportName, reinterpret_cast<void *>(WriteOutput));
+    }
+
+    MIR_item_t BeginMainFunction()
+    {
+        FuncItem = NewFunction(MainFuncName, MakeResultTypes(MIR_T_I64),
+                               MakeArguments(Argument(BeginArgName, MIR_T_I64), Argument(EndArgName, MIR_T_I64),
+                                             Argument(OutputArgName, MIR_T_I64), Argument(InputArgName, MIR_T_I64)));
+        IsLoopFunction = false;
+        BeginFunction();
 
-        return reinterpret_cast<MainFunc>(entrypoint);
+        CurrentPtrReg = NewReg(CurrentPtrArgName);
+        AddInstruction(MIR_MOV, NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg));
+
+        return FuncItem;
     }
 
-    void BeginFunction()
+    // Loop functions are entered with the current cell being non-zero, and return the status along with the
+    // pointer they've left the loop at.
+    MIR_item_t BeginLoopFunction(std::size_t index)
     {
-        assert(!BeginArgReg);
-        assert(!EndArgReg);
-        assert(!CurrentPtrReg);
-        assert(!FuncItem);
-        assert(!ReadCharFuncProto);
-        assert(!WriteCharFuncProto);
-        assert(!MemoryUnderrunErrorLabel);
-        assert(!OutOfMemoryErrorLabel);
+        char name[64];
+        std::snprintf(name, std::size(name), "%s_%zu", LoopFuncName, index);
+        FuncItem = NewFunction(name, MakeResultTypes(MIR_T_I64, MIR_T_I64), MakeLoopArguments());
+        IsLoopFunction = true;
+        BeginFunction();
 
-        ReadCharFuncProto =
-            NewFunctionPrototype(ReadCharFuncName, MakeResultTypes(MIR_T_I64), MakeArguments(Argument("ptr", MIR_T_P)));
-        WriteCharFuncProto = NewFunctionPrototype(WriteCharFuncName, MakeResultTypes(MIR_T_I64),
-                                                  MakeArguments(Argument("value", MIR_T_I64)));
+        CurrentPtrReg = GetReg(CurrentPtrArgName);
 
-        FuncItem = NewFunction(MainFuncName, MakeResultTypes(MIR_T_I64),
-                               MakeArguments(Argument(BeginArgName, MIR_T_I64), Argument(EndArgName, MIR_T_I64)));
+        return FuncItem;
+    }
+
+    void BeginFunction()
+    {
+        assert(FuncItem);
 
         BeginArgReg = GetReg(BeginArgName);
         EndArgReg = GetReg(EndArgName);
-
-        CurrentPtrReg = NewReg(CurrentPtrArgName);
-        AddInstruction(MIR_MOV, NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg));
+        OutputArgReg = GetReg(OutputArgName);
+        InputArgReg = GetReg(InputArgName);
+        CellReg = NewReg(CellRegName);
+        InvalidateCell();
+        ForgetRange();
 
         MemoryUnderrunErrorLabel = NewLabel();
         OutOfMemoryErrorLabel = NewLabel();
     }
 
+    void EndMainFunction()
+    {
+        if (GuardSize)
+        {
+            // The last move may have left the tape without touching a cell.
+            EmitPointerCheck();
+        }
+
+        EndFunction();
+    }
+
+    void EndLoopFunction()
+    {
+        // Loops are left with the current cell tested, so the pointer is known to be on the tape.
+        EndFunction();
+    }
+
     void EndFunction()
     {
-        assert(Labels.empty());
         assert(OutOfMemoryErrorLabel);
         assert(MemoryUnderrunErrorLabel);
 
+        FlushCell();
         AppendRetInstruction(Result::Success);
 
         std::array errorHandlers = {
@@ -166,144 +552,543 @@ struct CompilationUnit
         MIR_finish_func(Mir);
     }
 
-    void EmitInstructions()
+    void EmitOperations(const ir::Program &operations)
     {
-        assert(Labels.empty());
-
-        while (true)
+        for (const auto &operation : operations)
         {
-            const auto instruction = Reader.Next();
-            if (instruction == Instruction::Invalid)
+            switch (operation.Kind)
             {
+            case ir::OperationKind::AddCell:
+                EmitAddCellOperation(operation.Value, operation.Offset);
+                break;
+            case ir::OperationKind::SetCell:
+                EmitSetCellOperation(operation.Value, operation.Offset);
+                break;
+            case ir::OperationKind::MovePtr:
+                EmitMovePtrOperation(operation.Value);
+                break;
+            case ir::OperationKind::Loop:
+                EmitLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyLoop:
+                EmitLoopEntryCount(operation);
+                EmitMultiplyLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyAdd:
+                assert(false);
+                break;
+            case ir::OperationKind::ScanLoop:
+                EmitLoopEntryCount(operation);
+                EmitScanLoopOperation(operation.Value);
+                break;
+            case ir::OperationKind::WriteChar:
+                EmitWriteCharInstruction(operation.Offset);
+                break;
+            case ir::OperationKind::ReadChar:
+                EmitReadCharInstruction(operation.Offset);
+                break;
+            case ir::OperationKind::StoreBlock:
+                EmitStoreBlockOperation(operation);
+                break;
+            case ir::OperationKind::WriteBlock:
+                EmitWriteBlockOperation(operation);
                 break;
-            }
-            else
-            {
-                switch (instruction)
-                {
-                case Instruction::Inc:
-                    EmitIncInstruction();
-                    break;
-                case Instruction::Dec:
-                    EmitDecInstruction();
-                    break;
-                case Instruction::Next:
-                    EmitNextInstruction();
-                    break;
-                case Instruction::Prev:
-                    EmitPrevInstruction();
-                    break;
-                case Instruction::Jz:
-                    EmitJzInstruction();
-                    break;
-                case Instruction::Jnz:
-                    EmitJnzInstruction();
-                    break;
-                case Instruction::WriteChar:
-                    EmitWriteCharInstruction();
-                    break;
-                case Instruction::ReadChar:
-                    EmitReadCharInstruction();
-                    break;
-                case Instruction::Invalid:
-                    assert(false);
-                    break;
-                }
             }
         }
+    }
+
+    void EmitAddCellOperation(Int64 value, Int64 offset)
+    {
+        EmitAccessCheck(offset, offset);
+        const auto currentValue = LoadCell(offset);
+        AddInstruction(MIR_ADD, NewRegOp(currentValue), NewRegOp(currentValue), NewIntOp(value));
+        IsCellDirty = true;
+        IsCellNormalized = Cell::Bits == 64;
+    }
 
-        if (!Labels.empty())
+    void EmitSetCellOperation(Int64 value, Int64 offset = 0)
+    {
+        assert(CellReg);
+
+        EmitAccessCheck(offset, offset);
+        if (IsCellCached && CellOffset != offset)
         {
-            throw Exception("no matching close label found");
+            FlushCell();
         }
+
+        AddInstruction(MIR_MOV, NewRegOp(CellReg), NewIntOp(value));
+        CellOffset = offset;
+        IsCellCached = true;
+        IsCellDirty = true;
+        IsCellNormalized = Cell::IsNormalized(value);
     }
 
-    void EmitIncInstruction()
+    void EmitMovePtrOperation(Int64 distance)
     {
-        const auto currentValue = LoadCurrent();
-        AddInstruction(MIR_ADD, NewRegOp(currentValue), NewRegOp(currentValue), NewIntOp(1));
-        StoreCurrent(currentValue);
+        FlushCell();
+        InvalidateCell();
+
+        EmitAccessCheck(distance, distance);
+        AddInstruction(MIR_ADD, NewRegOp(CurrentPtrReg), NewRegOp(CurrentPtrReg), NewIntOp(distance * Cell::Bytes));
+
+        // The cells known to be on the tape stay there, including the one the pointer has moved to if it was checked.
+        KnownMinOffset -= distance;
+        KnownMaxOffset -= distance;
     }
 
-    void EmitDecInstruction()
+    Boolean IsKnown(Int64 minOffset, Int64 maxOffset) const noexcept
     {
-        const auto currentValue = LoadCurrent();
-        AddInstruction(MIR_SUB, NewRegOp(currentValue), NewRegOp(currentValue), NewIntOp(1));
-        StoreCurrent(currentValue);
+        return minOffset >= KnownMinOffset && maxOffset <= KnownMaxOffset;
     }
 
-    void EmitNextInstruction()
+    // Checks the cells about to be accessed unconditionally. The tape is contiguous, so every cell between the current
+    // one and a checked one is on it as well. Cells left to the guard regions aren't known to be on the tape until
+    // they're accessed, so they aren't remembered.
+    void EmitAccessCheck(Int64 minOffset, Int64 maxOffset)
     {
-        assert(OutOfMemoryErrorLabel);
+        if (IsKnown(minOffset, maxOffset) || !IsChecked(minOffset, maxOffset))
+        {
+            return;
+        }
+
+        EmitRangeCheck(minOffset, maxOffset);
+        KnownMinOffset = std::min(KnownMinOffset, minOffset);
+        KnownMaxOffset = std::max(KnownMaxOffset, maxOffset);
+    }
+
+    // Blocks may cover cells they never touch, so they're checked regardless of the guard regions.
+    void EmitBlockCheck(Int64 cells)
+    {
+        assert(cells > 0);
+
+        if (IsKnown(0, cells - 1))
+        {
+            return;
+        }
+
+        EmitRangeCheck(0, cells - 1);
+        KnownMaxOffset = std::max(KnownMaxOffset, cells - 1);
+    }
+
+    // Accesses within the guard regions fault on their own. The tape holds whole cells, so a cell reached by such a
+    // move lies entirely within the guard region.
+    Boolean IsChecked(Int64 minOffset, Int64 maxOffset) const noexcept
+    {
+        const auto guardCells = static_cast<Int64>(GuardSize) / Cell::Bytes;
+        return maxOffset > guardCells || -minOffset > guardCells;
+    }
 
-        AddInstruction(MIR_BEQ, NewLabelOp(OutOfMemoryErrorLabel), NewRegOp(CurrentPtrReg), NewRegOp(EndArgReg));
-        AddInstruction(MIR_ADD, NewRegOp(CurrentPtrReg), NewRegOp(CurrentPtrReg), NewIntOp(1));
+    void ForgetRange() noexcept
+    {
+        KnownMinOffset = 0;
+        KnownMaxOffset = 0;
     }
 
-    void EmitPrevInstruction()
+    void EmitRangeCheck(Int64 minOffset, Int64 maxOffset)
     {
+        assert(OutOfMemoryErrorLabel);
         assert(MemoryUnderrunErrorLabel);
+        assert(minOffset <= maxOffset);
 
-        AddInstruction(MIR_BEQ, NewLabelOp(MemoryUnderrunErrorLabel), NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg));
-        AddInstruction(MIR_SUB, NewRegOp(CurrentPtrReg), NewRegOp(CurrentPtrReg), NewIntOp(1));
+        // The room left is measured before moving, so that a huge distance can't wrap the pointer around.
+        if (maxOffset > 0)
+        {
+            const auto room = NewReg();
+            AddInstruction(MIR_SUB, NewRegOp(room), NewRegOp(EndArgReg), NewRegOp(CurrentPtrReg));
+            AddInstruction(MIR_UBLE, NewLabelOp(OutOfMemoryErrorLabel), NewRegOp(room),
+                           NewIntOp(maxOffset * Cell::Bytes));
+        }
+
+        if (minOffset < 0)
+        {
+            const auto room = NewReg();
+            AddInstruction(MIR_SUB, NewRegOp(room), NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg));
+            AddInstruction(MIR_UBLT, NewLabelOp(MemoryUnderrunErrorLabel), NewRegOp(room),
+                           NewIntOp(-minOffset * Cell::Bytes));
+        }
     }
 
-    void EmitJzInstruction()
+    void EmitLoopOperation(const ir::Operation &loop)
     {
+        if (Tiered && &loop != OutlinedLoop)
+        {
+            EmitLoopCall(Tiered->LoopIndex(loop));
+            return;
+        }
+
+        if (const auto funcItem = OutlinedFuncItems.find(&loop); funcItem != OutlinedFuncItems.end())
+        {
+            EmitOutlinedLoopCall(funcItem->second);
+            return;
+        }
+
+        const auto counters = EmitLoopEntryCount(loop);
         const auto openLabel = NewLabel();
         const auto closeLabel = NewLabel();
-        Labels.push(LabelPair{.OpenLabel = openLabel, .CloseLabel = closeLabel});
 
-        const auto currentValue = LoadCurrent();
-        AddInstruction(MIR_BEQ, NewLabelOp(closeLabel), NewRegOp(currentValue), NewIntOp(0));
-        AppendInstruction(openLabel);
+        const auto entryValue = LoadCellForTest();
+        AddInstruction(MIR_BEQ, NewLabelOp(closeLabel), NewRegOp(entryValue), NewIntOp(0));
+
+        // Balanced loops start every iteration where they were entered, so the cells all of their iterations access
+        // are checked once before the first one. Other loops have them checked at the start of every iteration.
+        const auto range = ir::AnalyzeLoopRange(loop);
+        const auto knownMinOffset = KnownMinOffset;
+        const auto knownMaxOffset = KnownMaxOffset;
+        if (range.IsBalanced)
+        {
+            EmitAccessCheck(range.MinOffset, range.MaxOffset);
+        }
+
+        const auto bodyMinOffset = KnownMinOffset;
+        const auto bodyMaxOffset = KnownMaxOffset;
+        AppendJoinLabel(openLabel);
+        if (range.IsBalanced)
+        {
+            KnownMinOffset = bodyMinOffset;
+            KnownMaxOffset = bodyMaxOffset;
+        }
+
+        if (counters)
+        {
+            EmitCounterIncrement(&counters->Iterations);
+        }
+
+        if (!range.IsBalanced)
+        {
+            EmitAccessCheck(range.MinOffset, range.MaxOffset);
+        }
+        EmitOperations(loop.Body);
+
+        const auto exitValue = LoadCellForTest();
+        if (Tiered)
+        {
+            AddInstruction(MIR_BEQ, NewLabelOp(closeLabel), NewRegOp(exitValue), NewIntOp(0));
+            EmitTierUpCheck(Tiered->LoopIndex(loop), openLabel);
+        }
+        else
+        {
+            AddInstruction(MIR_BNE, NewLabelOp(openLabel), NewRegOp(exitValue), NewIntOp(0));
+        }
+        AppendJoinLabel(closeLabel);
+        if (range.IsBalanced)
+        {
+            KnownMinOffset = knownMinOffset;
+            KnownMaxOffset = knownMaxOffset;
+        }
+    }
+
+    // Counts an iteration and keeps looping until the loop turns hot. A hot loop returns right before its next
+    // iteration, which looks the same as entering it anew to the caller.
+    void EmitTierUpCheck(std::size_t index, MIR_label_t openLabel)
+    {
+        assert(Tiered);
+        assert(IsLoopFunction);
+
+        const auto counterValue = EmitCounterIncrement(&Tiered->Counters[index]);
+        AddInstruction(MIR_BNE, NewLabelOp(openLabel), NewRegOp(counterValue), NewIntOp(Tiered->TierUpThreshold));
+
+        // Only this path leaves the function, so the cache state of the fall-through code stays as it is.
+        if (IsCellDirty)
+        {
+            AddInstruction(MIR_MOV, NewMemOp(CurrentPtrReg, CellOffset * Cell::Bytes), NewRegOp(CellReg));
+        }
+        AppendRetInstruction(NewIntOp(TierUpStatus));
+    }
+
+    // Returns the register holding the incremented value.
+    MIR_reg_t EmitCounterIncrement(UInt64 *counter)
+    {
+        assert(counter);
+
+        const auto counterPtr = NewReg();
+        const auto counterValue = NewReg();
+        AddInstruction(MIR_MOV, NewRegOp(counterPtr), NewIntOp(reinterpret_cast<std::int64_t>(counter)));
+        AddInstruction(MIR_MOV, NewRegOp(counterValue), NewMemOp(counterPtr, 0, MIR_T_U64));
+        AddInstruction(MIR_ADD, NewRegOp(counterValue), NewRegOp(counterValue), NewIntOp(1));
+        AddInstruction(MIR_MOV, NewMemOp(counterPtr, 0, MIR_T_U64), NewRegOp(counterValue));
+
+        return counterValue;
+    }
+
+    // Loops are instrumented in the order they appear in, matching the counters listed by `LoopProfile::Reset`.
+    LoopCounters *EmitLoopEntryCount(const ir::Operation &loop)
+    {
+        if (!Profile)
+        {
+            return nullptr;
+        }
+
+        assert(NextProfiledLoop < Profile->Loops.size());
+        auto &counters = Profile->Loops[NextProfiledLoop++];
+        assert(counters.Kind == loop.Kind && counters.Position == loop.Position);
+
+        EmitCounterIncrement(&counters.Entries);
+        return &counters;
+    }
+
+    void EmitLoopCall(std::size_t index)
+    {
+        assert(Tiered);
+
+        const auto skipLabel = NewLabel();
+        const auto entryValue = LoadCellForTest();
+        AddInstruction(MIR_BEQ, NewLabelOp(skipLabel), NewRegOp(entryValue), NewIntOp(0));
+        FlushCell();
+
+        // The entry is reloaded on every call, as the loop may have been promoted in the meantime.
+        const auto retryLabel = NewLabel();
+        const auto doneLabel = NewLabel();
+        const auto failLabel = NewLabel();
+        const auto entryPtr = NewReg();
+        const auto loopFuncPtr = NewReg();
+        const auto statusValue = NewReg();
+        AppendInstruction(retryLabel);
+        AddInstruction(MIR_MOV, NewRegOp(entryPtr), NewIntOp(reinterpret_cast<std::int64_t>(&Tiered->Entries[index])));
+        AddInstruction(MIR_MOV, NewRegOp(loopFuncPtr), NewMemOp(entryPtr, 0, MIR_T_P));
+        AppendCallInstruction(NewRefOp(LoopFuncProto), NewRegOp(loopFuncPtr), NewRegOp(statusValue),
+                              NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg), NewRegOp(EndArgReg),
+                              NewRegOp(CurrentPtrReg), NewRegOp(OutputArgReg), NewRegOp(InputArgReg));
+        AddInstruction(MIR_BEQ, NewLabelOp(doneLabel), NewRegOp(statusValue), NewIntOp(Result::Success));
+        AddInstruction(MIR_BNE, NewLabelOp(failLabel), NewRegOp(statusValue), NewIntOp(TierUpStatus));
+        AppendCallInstruction(NewRefOp(PromoteLoopFuncProto), NewFuncPtrOp(TieredProgram::PromoteLoop),
+                              NewIntOp(reinterpret_cast<std::int64_t>(Tiered)), NewIntOp(static_cast<Int64>(index)));
+        AddInstruction(MIR_JMP, NewLabelOp(retryLabel));
+        AppendInstruction(failLabel);
+        AppendRetInstruction(NewRegOp(statusValue));
+
+        // The loop has written the cell back, and only leaves it once it's zero.
+        AppendInstruction(doneLabel);
+        AddInstruction(MIR_MOV, NewRegOp(CellReg), NewIntOp(0));
+        AppendJoinLabel(skipLabel);
+    }
+
+    void EmitOutlinedLoopCall(MIR_item_t loopFuncItem)
+    {
+        const auto skipLabel = NewLabel();
+        const auto doneLabel = NewLabel();
+        const auto entryValue = LoadCellForTest();
+        AddInstruction(MIR_BEQ, NewLabelOp(skipLabel), NewRegOp(entryValue), NewIntOp(0));
+        FlushCell();
+
+        const auto statusValue = NewReg();
+        AppendCallInstruction(NewRefOp(LoopFuncProto), NewRefOp(loopFuncItem), NewRegOp(statusValue),
+                              NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg), NewRegOp(EndArgReg),
+                              NewRegOp(CurrentPtrReg), NewRegOp(OutputArgReg), NewRegOp(InputArgReg));
+        AddInstruction(MIR_BEQ, NewLabelOp(doneLabel), NewRegOp(statusValue), NewIntOp(Result::Success));
+        AppendRetInstruction(NewRegOp(statusValue));
+
+        // The loop has written the cell back, and only leaves it once it's zero.
+        AppendInstruction(doneLabel);
+        AddInstruction(MIR_MOV, NewRegOp(CellReg), NewIntOp(0));
+        AppendJoinLabel(skipLabel);
+    }
+
+    void EmitPointerCheck()
+    {
+        assert(OutOfMemoryErrorLabel);
+        assert(MemoryUnderrunErrorLabel);
+
+        AddInstruction(MIR_UBGE, NewLabelOp(OutOfMemoryErrorLabel), NewRegOp(CurrentPtrReg), NewRegOp(EndArgReg));
+        AddInstruction(MIR_UBLT, NewLabelOp(MemoryUnderrunErrorLabel), NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg));
+    }
+
+    void EmitMultiplyLoopOperation(const ir::Operation &loop)
+    {
+        const auto &body = loop.Body;
+        assert(!body.empty());
+
+        const auto skipLabel = NewLabel();
+        const auto counterValue = LoadCellForTest();
+        AddInstruction(MIR_BEQ, NewLabelOp(skipLabel), NewRegOp(counterValue), NewIntOp(0));
+
+        // Targets are sorted by offset, and the loop would have visited every one of them. The check only runs when the
+        // loop does, so it isn't remembered, unlike what was known before. Within the guard regions the outermost
+        // target faults by itself, as long as the loop has targets on one side only and adds something to it. Otherwise
+        // the range is checked, and since the end of a range is checked before its start, the start is checked on its
+        // own first when the loop would have run off it first.
+        const auto knownMinOffset = KnownMinOffset;
+        const auto knownMaxOffset = KnownMaxOffset;
+        const auto minOffset = body.front().Offset;
+        const auto maxOffset = body.back().Offset;
+        const auto isTwoSided = minOffset < 0 && maxOffset > 0;
+        const auto &outermost = maxOffset > 0 ? body.back() : body.front();
+        const auto isFaulting = !isTwoSided && outermost.Value != 0;
+        if (!IsKnown(minOffset, maxOffset) && (IsChecked(minOffset, maxOffset) || !isFaulting))
+        {
+            if (isTwoSided && loop.Value == minOffset)
+            {
+                EmitRangeCheck(minOffset, minOffset);
+            }
+            EmitRangeCheck(minOffset, maxOffset);
+        }
+        for (const auto &operation : body)
+        {
+            assert(operation.Kind == ir::OperationKind::MultiplyAdd);
+
+            if (operation.Value == 0)
+            {
+                continue;
+            }
+
+            const auto product = NewReg();
+            const auto targetValue = NewReg();
+            AddInstruction(MIR_MUL, NewRegOp(product), NewRegOp(counterValue), NewIntOp(operation.Value));
+            const auto displacement = operation.Offset * Cell::Bytes;
+            AddInstruction(MIR_MOV, NewRegOp(targetValue), NewMemOp(CurrentPtrReg, displacement));
+            AddInstruction(MIR_ADD, NewRegOp(targetValue), NewRegOp(targetValue), NewRegOp(product));
+            AddInstruction(MIR_MOV, NewMemOp(CurrentPtrReg, displacement), NewRegOp(targetValue));
+        }
+
+        EmitSetCellOperation(0);
+        AppendJoinLabel(skipLabel);
+        KnownMinOffset = knownMinOffset;
+        KnownMaxOffset = knownMaxOffset;
     }
 
-    void EmitJnzInstruction()
+    void EmitScanLoopOperation(Int64 stride)
     {
-        if (Labels.empty())
+        assert(stride != 0);
+
+        // Testing the first cell here skips the call for loops that don't run, and makes the access that lands in
+        // a guard region fault in the generated code rather than in the kernel.
+        const auto skipLabel = NewLabel();
+        const auto currentValue = LoadCellForTest();
+        AddInstruction(MIR_BEQ, NewLabelOp(skipLabel), NewRegOp(currentValue), NewIntOp(0));
+        FlushCell();
+
+        // The scan kernels count the stride in cells, and return null instead of walking off the tape.
+        const auto foundPtr = NewReg();
+        if (stride > 0)
         {
-            throw Exception("no matching open label found");
+            AppendCallInstruction(NewRefOp(ScanFuncProto), NewRefOp(ScanForwardFuncImport), NewRegOp(foundPtr),
+                                  NewRegOp(CurrentPtrReg), NewRegOp(EndArgReg), NewIntOp(stride));
+            AddInstruction(MIR_BEQ, NewLabelOp(OutOfMemoryErrorLabel), NewRegOp(foundPtr), NewIntOp(0));
+        }
+        else
+        {
+            AppendCallInstruction(NewRefOp(ScanFuncProto), NewRefOp(ScanBackwardFuncImport), NewRegOp(foundPtr),
+                                  NewRegOp(CurrentPtrReg), NewRegOp(BeginArgReg), NewIntOp(-stride));
+            AddInstruction(MIR_BEQ, NewLabelOp(MemoryUnderrunErrorLabel), NewRegOp(foundPtr), NewIntOp(0));
         }
 
-        const auto labels = Labels.top();
-        Labels.pop();
+        AddInstruction(MIR_MOV, NewRegOp(CurrentPtrReg), NewRegOp(foundPtr));
+        ForgetRange();
+        EmitSetCellOperation(0);
+        AppendJoinLabel(skipLabel);
+    }
 
-        assert(labels.OpenLabel);
-        assert(labels.CloseLabel);
+    void EmitWriteCharInstruction(Int64 offset)
+    {
+        assert(OutputArgReg);
+
+        EmitAccessCheck(offset, offset);
+        const auto currentValue = LoadCellForTest(offset);
+        if (GuardSize)
+        {
+            // Nothing may be written out before a move into a guard region faults.
+            FlushCell();
+        }
+
+        const auto cursorPtr = NewReg();
+        const auto limitPtr = NewReg();
+        const auto storeLabel = NewLabel();
+        AddInstruction(MIR_MOV, NewRegOp(cursorPtr), NewFieldOp(OutputArgReg, offsetof(OutputBuffer, Cursor)));
+        AddInstruction(MIR_MOV, NewRegOp(limitPtr), NewFieldOp(OutputArgReg, offsetof(OutputBuffer, Limit)));
+        AddInstruction(MIR_BNE, NewLabelOp(storeLabel), NewRegOp(cursorPtr), NewRegOp(limitPtr));
+
+        const auto flushFuncPtr = NewReg();
+        const auto flushStatusValue = NewReg();
+        const auto flushSuccessLabel = NewLabel();
+        AddInstruction(MIR_MOV, NewRegOp(flushFuncPtr), NewFieldOp(OutputArgReg, offsetof(OutputBuffer, Flush)));
+        AppendCallInstruction(NewRefOp(FlushOutputFuncProto), NewRegOp(flushFuncPtr), NewRegOp(flushStatusValue),
+                              NewRegOp(OutputArgReg));
+        AddInstruction(MIR_BEQ, NewLabelOp(flushSuccessLabel), NewRegOp(flushStatusValue), NewIntOp(Result::Success));
+        AppendRetInstruction(NewRegOp(flushStatusValue));
+        AppendInstruction(flushSuccessLabel);
+        AddInstruction(MIR_MOV, NewRegOp(cursorPtr), NewFieldOp(OutputArgReg, offsetof(OutputBuffer, Cursor)));
+
+        // Wider cells are written out as their lowest byte.
+        AppendInstruction(storeLabel);
+        AddInstruction(MIR_MOV, NewMemOp(cursorPtr, 0, MIR_T_U8), NewRegOp(currentValue));
+        AddInstruction(MIR_ADD, NewRegOp(cursorPtr), NewRegOp(cursorPtr), NewIntOp(1));
+        AddInstruction(MIR_MOV, NewFieldOp(OutputArgReg, offsetof(OutputBuffer, Cursor)), NewRegOp(cursorPtr));
+    }
+
+    void EmitReadCharInstruction(Int64 offset)
+    {
+        assert(InputArgReg);
+
+        EmitAccessCheck(offset, offset);
+        if (IsCellCached && CellOffset != offset)
+        {
+            FlushCell();
+        }
 
-        const auto currentValue = LoadCurrent();
-        AddInstruction(MIR_BNE, NewLabelOp(labels.OpenLabel), NewRegOp(currentValue), NewIntOp(0));
-        AppendInstruction(labels.CloseLabel);
+        // The character goes straight into the cached cell, so a move into a guard region still faults when it's
+        // written back.
+        const auto cursorPtr = NewReg();
+        const auto limitPtr = NewReg();
+        const auto loadLabel = NewLabel();
+        AddInstruction(MIR_MOV, NewRegOp(cursorPtr), NewFieldOp(InputArgReg, offsetof(InputBuffer, Cursor)));
+        AddInstruction(MIR_MOV, NewRegOp(limitPtr), NewFieldOp(InputArgReg, offsetof(InputBuffer, Limit)));
+        AddInstruction(MIR_BNE, NewLabelOp(loadLabel), NewRegOp(cursorPtr), NewRegOp(limitPtr));
+
+        const auto refillFuncPtr = NewReg();
+        const auto refillStatusValue = NewReg();
+        const auto refillSuccessLabel = NewLabel();
+        AddInstruction(MIR_MOV, NewRegOp(refillFuncPtr), NewFieldOp(InputArgReg, offsetof(InputBuffer, Refill)));
+        AppendCallInstruction(NewRefOp(RefillInputFuncProto), NewRegOp(refillFuncPtr), NewRegOp(refillStatusValue),
+                              NewRegOp(InputArgReg));
+        AddInstruction(MIR_BEQ, NewLabelOp(refillSuccessLabel), NewRegOp(refillStatusValue), NewIntOp(Result::Success));
+        AppendRetInstruction(NewRegOp(refillStatusValue));
+        AppendInstruction(refillSuccessLabel);
+        AddInstruction(MIR_MOV, NewRegOp(cursorPtr), NewFieldOp(InputArgReg, offsetof(InputBuffer, Cursor)));
+
+        AppendInstruction(loadLabel);
+        AddInstruction(MIR_MOV, NewRegOp(CellReg), NewMemOp(cursorPtr, 0, MIR_T_U8));
+        AddInstruction(MIR_ADD, NewRegOp(cursorPtr), NewRegOp(cursorPtr), NewIntOp(1));
+        AddInstruction(MIR_MOV, NewFieldOp(InputArgReg, offsetof(InputBuffer, Cursor)), NewRegOp(cursorPtr));
+        CellOffset = offset;
+        IsCellCached = true;
+        IsCellDirty = true;
+        IsCellNormalized = true;
     }
 
-    void EmitWriteCharInstruction()
+    void EmitStoreBlockOperation(const ir::Operation &operation)
     {
-        assert(WriteChar);
+        assert(operation.Value > 0);
+
+        FlushCell();
+        InvalidateCell();
 
-        const auto currentValue = LoadCurrent();
-        const auto writeStatusValue = NewReg();
-        AppendCallInstruction(NewRefOp(WriteCharFuncProto), NewFuncPtrOp(WriteChar), NewRegOp(writeStatusValue),
-                              NewRegOp(currentValue));
+        EmitBlockCheck(operation.Value);
+        if (operation.Data.empty())
+        {
+            return;
+        }
 
-        const auto writeSuccessLabel = NewLabel();
-        AddInstruction(MIR_BEQ, NewLabelOp(writeSuccessLabel), NewRegOp(writeStatusValue), NewIntOp(Result::Success));
-        AppendRetInstruction(NewRegOp(writeStatusValue));
-        AppendInstruction(writeSuccessLabel);
+        AppendCallInstruction(NewRefOp(CopyFuncProto), NewRefOp(CopyFuncImport), NewRegOp(NewReg()),
+                              NewRegOp(CurrentPtrReg), NewRefOp(BlockDataItems.at(&operation)),
+                              NewIntOp(static_cast<Int64>(operation.Data.size())));
     }
 
-    void EmitReadCharInstruction()
+    void EmitWriteBlockOperation(const ir::Operation &operation)
     {
-        assert(ReadChar);
+        assert(OutputArgReg);
 
-        const auto readStatusValue = NewReg();
-        AppendCallInstruction(NewRefOp(ReadCharFuncProto), NewFuncPtrOp(ReadChar), NewRegOp(readStatusValue),
-                              NewRegOp(CurrentPtrReg));
+        if (operation.Data.empty())
+        {
+            return;
+        }
 
-        const auto readSuccessLabel = NewLabel();
-        AddInstruction(MIR_BEQ, NewLabelOp(readSuccessLabel), NewRegOp(readStatusValue), NewIntOp(Result::Success));
-        AppendRetInstruction(NewRegOp(readStatusValue));
-        AppendInstruction(readSuccessLabel);
+        const auto statusValue = NewReg();
+        const auto successLabel = NewLabel();
+        AppendCallInstruction(NewRefOp(WriteBlockFuncProto), NewRefOp(WriteBlockFuncImport), NewRegOp(statusValue),
+                              NewRegOp(OutputArgReg), NewRefOp(BlockDataItems.at(&operation)),
+                              NewIntOp(static_cast<Int64>(operation.Data.size())));
+        AddInstruction(MIR_BEQ, NewLabelOp(successLabel), NewRegOp(statusValue), NewIntOp(Result::Success));
+        AppendRetInstruction(NewRegOp(statusValue));
+        AppendInstruction(successLabel);
     }
 
     template <typename RetTypes, typename ArgTypes>
@@ -363,24 +1148,83 @@ struct CompilationUnit
     {
         assert(Mir);
 
+        if (Statistics)
+        {
+            ++Statistics->MirLabels;
+        }
+
         return MIR_new_label(Mir);
     }
 
-    MIR_reg_t LoadCurrent()
+    // The last cell accessed lives in `CellReg` while it's cached, and is only written back before the pointer moves,
+    // another cell is accessed or the tape is accessed by someone else. Arithmetic isn't truncated to the cell width
+    // until the value is compared or handed out.
+    MIR_reg_t LoadCell(Int64 offset = 0)
     {
         assert(CurrentPtrReg);
+        assert(CellReg);
+
+        if (IsCellCached && CellOffset != offset)
+        {
+            FlushCell();
+            InvalidateCell();
+        }
+
+        if (!IsCellCached)
+        {
+            AddInstruction(MIR_MOV, NewRegOp(CellReg), NewMemOp(CurrentPtrReg, offset * Cell::Bytes));
+            CellOffset = offset;
+            IsCellCached = true;
+            IsCellDirty = false;
+            IsCellNormalized = true;
+        }
 
-        const auto currentValue = NewReg();
-        AddInstruction(MIR_MOV, NewRegOp(currentValue), NewMemOp(CurrentPtrReg));
+        return CellReg;
+    }
 
-        return currentValue;
+    MIR_reg_t LoadCellForTest(Int64 offset = 0)
+    {
+        const auto value = LoadCell(offset);
+        if constexpr (Cell::Bits < 64)
+        {
+            if (!IsCellNormalized)
+            {
+                AddInstruction(MirCell<Cell>::Extension, NewRegOp(value), NewRegOp(value));
+                IsCellNormalized = true;
+            }
+        }
+
+        return value;
     }
 
-    void StoreCurrent(MIR_reg_t value)
+    void FlushCell()
     {
         assert(CurrentPtrReg);
 
-        AddInstruction(MIR_MOV, NewMemOp(CurrentPtrReg), NewRegOp(value));
+        if (IsCellCached && IsCellDirty)
+        {
+            AddInstruction(MIR_MOV, NewMemOp(CurrentPtrReg, CellOffset * Cell::Bytes), NewRegOp(CellReg));
+            IsCellDirty = false;
+        }
+    }
+
+    void InvalidateCell()
+    {
+        IsCellCached = false;
+        IsCellDirty = false;
+    }
+
+    // Control only reaches join labels with the current cell tested, hence cached and normalized, on every incoming
+    // edge. Whether it was written back on all of them isn't tracked, so it's conservatively assumed it wasn't, and
+    // neither are the cells known to be on the tape.
+    void AppendJoinLabel(MIR_label_t label)
+    {
+        AppendInstruction(label);
+        ForgetRange();
+        CellOffset = 0;
+        IsCellCached = true;
+        IsCellDirty = true;
+        IsCellNormalized = true;
     }
 
     MIR_reg_t NewReg(const char *name = nullptr)
@@ -395,14 +1239,26 @@ struct CompilationUnit
             name = regNameBuffer;
         }
 
+        if (Statistics)
+        {
+            ++Statistics->MirRegisters;
+        }
+
         return MIR_new_func_reg(Mir, FuncItem->u.func, MIR_T_I64, name);
     }
 
-    MIR_op_t NewMemOp(MIR_reg_t pointerReg)
+    MIR_op_t NewMemOp(MIR_reg_t pointerReg, Int64 displacement = 0, MIR_type_t type = MirCell<Cell>::Type)
     {
         assert(Mir);
 
-        return MIR_new_mem_op(Mir, MIR_T_U8, 0, pointerReg, 0, 0);
+        return MIR_new_mem_op(Mir, type, displacement, pointerReg, 0, 0);
+    }
+
+    MIR_op_t NewFieldOp(MIR_reg_t structPtrReg, std::size_t fieldOffset)
+    {
+        assert(structPtrReg);
+
+        return NewMemOp(structPtrReg, static_cast<Int64>(fieldOffset), MIR_T_P);
     }
 
     template <typename Result, typename... Args> MIR_op_t NewFuncPtrOp(Result (*ptr)(Args...))
@@ -432,6 +1288,11 @@ struct CompilationUnit
         assert(Mir);
         assert(FuncItem);
 
+        if (Statistics)
+        {
+            ++Statistics->MirInstructions;
+        }
+
         MIR_append_insn(Mir, FuncItem, instruction);
     }
 
@@ -439,7 +1300,14 @@ struct CompilationUnit
     {
         assert(Mir);
 
-        AppendInstruction(MIR_new_ret_insn(Mir, 1, result));
+        if (IsLoopFunction)
+        {
+            AppendInstruction(MIR_new_ret_insn(Mir, 2, result, NewRegOp(CurrentPtrReg)));
+        }
+        else
+        {
+            AppendInstruction(MIR_new_ret_insn(Mir, 1, result));
+        }
     }
 
     void AppendRetInstruction(Result result)
@@ -459,13 +1327,37 @@ struct CompilationUnit
         AppendInstruction(NewInstruction(code, args...));
     }
 };
+
+void TieredProgram::Promote(std::size_t index)
+{
+    assert(index < Loops.size());
+
+    MIR_gen_set_optimize_level(Mir, 0, TierUpOptimizationLevel);
+    const auto entry = DispatchCellBits(CellBits, [&](auto cell) {
+        auto compilationUnit = CompilationUnit<decltype(cell)>{
+            .Mir = Mir,
+            .GuardSize = GuardSize,
+        };
+        return compilationUnit.CompileLoop(*Loops[index], index);
+    });
+    MIR_gen_set_optimize_level(Mir, 0, 0);
+
+    Entries[index] = entry;
+}
 } // namespace
 
-struct MirCompiler::Impl
+// Owns the MIR context of a single program along with the state its code refers to. MIR can't unload modules, so the
+// context is only freed as a whole, once the last copy of the program's entrypoint holding a reference to it is gone,
+// which also keeps the code valid once the compiler is gone.
+struct MirContext
 {
     MIR_context_t Mir;
+    // Promoted loops are compiled while the program runs, so its state has to outlive the compiled code.
+    std::unique_ptr<TieredProgram> Tiered;
+    Boolean IsFailed = false;
+    Boolean IsGeneratorRunning = true;
 
-    Impl()
+    MirContext(UInt32 optimizationLevel, UInt32 generatorThreads)
     {
         Mir = MIR_init();
         if (!Mir)
@@ -473,58 +1365,267 @@ struct MirCompiler::Impl
             throw Exception("failed to initialize mir context");
         }
 
-        MIR_gen_init(Mir, 0);
+        MIR_set_error_func(Mir, ThrowMirError);
+
+        const auto generators = static_cast<int>(generatorThreads);
+        MIR_gen_init(Mir, generators);
+        for (auto generator = 0; generator < generators; ++generator)
+        {
+            MIR_gen_set_optimize_level(Mir, generator, optimizationLevel);
+        }
     }
 
-    ~Impl()
+    MirContext(const MirContext &) = delete;
+
+    MirContext &operator=(const MirContext &) = delete;
+
+    // A context which failed to compile may be left half way through an update, which `MIR_finish` would report as
+    // another error, so it's leaked instead.
+    ~MirContext()
     {
-        MIR_gen_finish(Mir);
+        if (IsFailed || (Tiered && Tiered->IsFailed))
+        {
+            return;
+        }
+
+        if (IsGeneratorRunning)
+        {
+            MIR_gen_finish(Mir);
+        }
         MIR_finish(Mir);
     }
 
-    MainFunc Compile(const CompilerContext &context)
+    // The generated code stays valid without the generator, which would hold on to its threads otherwise.
+    void FinishGenerator()
+    {
+        assert(IsGeneratorRunning);
+
+        MIR_gen_finish(Mir);
+        IsGeneratorRunning = false;
+    }
+};
+
+// Compiles a single program into the context it's given.
+struct ProgramCompiler
+{
+    const MirCompilerOptions &Options;
+    MirContext &Context;
+    MIR_context_t Mir;
+
+    template <typename Cell> MainFunc Compile(const CompilerContext &context)
     {
         assert(Mir);
-        assert(context.WriteChar);
-        assert(context.ReadChar);
         assert(context.Reader);
 
-        auto compilationUnit = CompilationUnit{
+        // Tier 0 and profiled code refer to tables of this very process, so they're never cached. Promoted loops
+        // aren't instrumented, hence profiling turns tiering off.
+        if (Options.CacheDirectory && !Options.Tiered && !context.Profile)
+        {
+            return CompileCached<Cell>(context);
+        }
+
+        auto program = BuildProgram<Cell>(*context.Reader, context);
+        if (Options.Tiered && !context.Profile)
+        {
+            Context.Tiered = std::make_unique<TieredProgram>(Mir, std::move(program), context.GuardSize, Cell::Bits,
+                                                             Options.TierUpThreshold);
+            auto compilationUnit = CompilationUnit<Cell>{
+                .Mir = Mir,
+                .GuardSize = context.GuardSize,
+                .Tiered = Context.Tiered.get(),
+                .Lazy = Options.Lazy,
+                .Statistics = context.Statistics,
+            };
+            return compilationUnit.Compile(Context.Tiered->Program);
+        }
+
+        if (context.Profile)
+        {
+            context.Profile->Reset(program);
+        }
+
+        // Outlined loops are emitted out of order, which the profile counters can't follow.
+        auto compilationUnit = CompilationUnit<Cell>{
             .Mir = Mir,
-            .WriteChar = context.WriteChar,
-            .ReadChar = context.ReadChar,
-            .Reader = *context.Reader,
+            .GuardSize = context.GuardSize,
+            .OutlineThreshold = context.Profile ? 0 : Options.OutlineThreshold,
+            .Lazy = Options.Lazy,
+            .Statistics = context.Statistics,
+            .Profile = context.Profile,
         };
-        return compilationUnit.Compile();
+        return compilationUnit.Compile(program);
+    }
+
+    // The key covers the instructions rather than the source text, so that editing comments keeps the entry valid.
+    template <typename Cell> MainFunc CompileCached(const CompilerContext &context)
+    {
+        assert(Options.CacheDirectory);
+
+        Vector<Instruction> instructions;
+        for (auto instruction = context.Reader->Next(); instruction != Instruction::Invalid;
+             instruction = context.Reader->Next())
+        {
+            instructions.push_back(instruction);
+        }
+
+        const auto key = CacheKey()
+                             .Add(CacheFormatVersion)
+                             .Add(static_cast<double>(MIR_API_VERSION))
+                             .Add(Options.OptimizationLevel)
+                             .Add(context.GuardSize)
+                             .Add(Cell::Bits)
+                             .Add(context.PrefixSteps)
+                             .Add(instructions);
+        const CompilationCache cache(*Options.CacheDirectory);
+        auto entry = cache.Load(key);
+        const auto stream = entry ? FilePtr(fmemopen(entry->data(), entry->size(), "rb"), std::fclose)
+                                  : FilePtr(nullptr, std::fclose);
+        if (stream)
+        {
+            MIR_read(Mir, stream.get());
+            auto compilationUnit = CompilationUnit<Cell>{
+                .Mir = Mir,
+                .GuardSize = context.GuardSize,
+                .Lazy = Options.Lazy,
+                .Statistics = context.Statistics,
+                .Module = DLIST_TAIL(MIR_module_t, *MIR_get_module_list(Mir)),
+            };
+            return compilationUnit.Load(FindFunction(compilationUnit.Module, MainFuncName));
+        }
+
+        SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+        const auto program = BuildProgram<Cell>(reader, context);
+        auto compilationUnit = CompilationUnit<Cell>{
+            .Mir = Mir,
+            .GuardSize = context.GuardSize,
+            .OutlineThreshold = Options.OutlineThreshold,
+            .Lazy = Options.Lazy,
+            .Statistics = context.Statistics,
+        };
+        const auto mainFuncItem = compilationUnit.EmitModule(program);
+        if (const auto contents = WriteModule(compilationUnit.Module))
+        {
+            cache.Store(key, *contents);
+        }
+
+        return compilationUnit.Load(mainFuncItem);
+    }
+
+    template <typename Cell> static ir::Program BuildProgram(InstructionReader &reader, const CompilerContext &context)
+    {
+        const Stopwatch stopwatch;
+        auto program = ir::BuildProgram(reader);
+        ir::Optimize<Cell>(program);
+        if (context.PrefixSteps)
+        {
+            ir::EvaluatePrefix<Cell>(program, context.PrefixSteps);
+        }
+        if (context.Statistics)
+        {
+            context.Statistics->BuildSeconds += stopwatch.ElapsedSeconds();
+        }
+
+        return program;
+    }
+
+    // Modules are written to memory, so that the cache can check them as a whole before they're read back.
+    Optional<Vector<CharType>> WriteModule(MIR_module_t module)
+    {
+        char *data = nullptr;
+        std::size_t size = 0;
+        const auto stream = open_memstream(&data, &size);
+        if (!stream)
+        {
+            return std::nullopt;
+        }
+
+        MIR_write_module(Mir, stream, module);
+        const auto isFailed = std::ferror(stream);
+        Optional<Vector<CharType>> contents;
+        if (std::fclose(stream) == 0 && !isFailed)
+        {
+            contents.emplace(data, data + size);
+        }
+
+        std::free(data);
+        return contents;
+    }
+
+    MIR_item_t FindFunction(MIR_module_t module, const char *name)
+    {
+        assert(module);
+
+        for (auto item = DLIST_HEAD(MIR_item_t, module->items); item; item = DLIST_NEXT(MIR_item_t, item))
+        {
+            if (item->item_type == MIR_func_item && std::strcmp(MIR_item_name(Mir, item), name) == 0)
+            {
+                return item;
+            }
+        }
+
+        throw Exception::Formatted("cached module {} has no function {}", module->name, name);
     }
 };
 
-MirCompiler::MirCompiler() : m_impl(std::make_unique<Impl>())
+struct MirCompiler::Impl
 {
-}
+    MirCompilerOptions Options;
 
+    explicit Impl(const MirCompilerOptions &options) : Options(options)
+    {
+        if (Options.OptimizationLevel > 3)
+        {
+            throw Exception::Formatted("unsupported optimization level {}", Options.OptimizationLevel);
+        }
+
+        if (!Options.GeneratorThreads)
+        {
+            throw Exception("the number of generator threads must be positive");
+        }
+    }
+};
+
+MirCompiler::MirCompiler(const MirCompilerOptions &options) : m_impl(std::make_unique<Impl>(options))
+{
+}
 MirCompiler::~MirCompiler()
 {
 }
 
-MainFunc MirCompiler::Compile(const CompilerContext &context)
+Entrypoint MirCompiler::Compile(const CompilerContext &context)
 {
     assert(m_impl);
 
-    if (!context.WriteChar)
+    if (!context.Reader)
     {
-        throw Exception("write char function must not be null");
+        throw Exception("instruction reader must not be null");
     }
 
-    if (!context.ReadChar)
+    // Tiered and lazy programs keep generating code one function at a time as they run, so they only get a single
+    // generator, while the code of the others is all there once they're compiled.
+    const auto &options = m_impl->Options;
+    const auto isGenerating = options.Tiered || options.Lazy;
+    auto owner = std::make_shared<MirContext>(options.Tiered ? 0 : options.OptimizationLevel,
+                                              isGenerating ? 1 : options.GeneratorThreads);
+    auto compiler = ProgramCompiler{.Options = options, .Context = *owner, .Mir = owner->Mir};
+    MainFunc mainFunc = nullptr;
+    try
+    {
+        mainFunc =
+            DispatchCellBits(context.CellBits, [&](auto cell) { return compiler.Compile<decltype(cell)>(context); });
+    }
+    catch (...)
     {
-        throw Exception("read char function must not be null");
+        owner->IsFailed = true;
+        throw;
     }
 
-    if (!context.Reader)
+    if (!isGenerating)
     {
-        throw Exception("instruction reader must not be null");
+        owner->FinishGenerator();
     }
 
-    return m_impl->Compile(context);
+    return [owner = std::move(owner), mainFunc](CharPtr begin, CharPtr end, OutputBuffer *output, InputBuffer *input) {
+        return mainFunc(begin, end, output, input);
+    };
 }
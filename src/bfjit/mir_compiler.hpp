@@ -7,14 +7,33 @@
 
 namespace bfjit
 {
+// A tiered compiler starts out with code generated at the lowest optimization level, each loop being a separate
+// function, and recompiles loops at the highest level once they've run `TierUpThreshold` iterations.
+// `OptimizationLevel` only applies to non-tiered compilation. Non-tiered programs are cached in `CacheDirectory`
+// when it's set, and have their loops of at least `OutlineThreshold` operations compiled as separate functions, zero
+// keeping them inline. Functions are generated by `GeneratorThreads` threads in parallel, or, when `Lazy` is set, one
+// by one as the program first calls them, so that loops which never run are never compiled. Lazily compiled programs
+// must not be run by several threads at once. Tiered and lazy programs are generated by a single thread, which they
+// keep for as long as they live, while the threads generating other programs are gone once they're compiled.
+struct MirCompilerOptions
+{
+    UInt32 OptimizationLevel = 2;
+    Boolean Tiered = false;
+    UInt32 TierUpThreshold = 1 << 14;
+    Optional<String> CacheDirectory;
+    UInt32 OutlineThreshold = 1 << 10;
+    UInt32 GeneratorThreads = 1;
+    Boolean Lazy = false;
+};
+
 class MirCompiler final : public CompilerBackend
 {
 public:
-    MirCompiler();
+    explicit MirCompiler(const MirCompilerOptions &options = {});
 
     ~MirCompiler() override;
 
-    MainFunc Compile(const CompilerContext &context) override;
+    Entrypoint Compile(const CompilerContext &context) override;
 
 private:
     struct Impl;
@@ -0,0 +1,269 @@
+#include "prefix.hpp"
+#include "cell.hpp"
+
+#include <cassert>
+#include <cstring>
+
+using namespace bfjit;
+using namespace bfjit::ir;
+
+namespace
+{
+// Bounds the size of the blocks the compiled program embeds.
+constexpr inline Int64 MaxTapeBytes = 1 << 16;
+constexpr inline std::size_t MaxOutputBytes = 1 << 20;
+
+// Evaluation functions return false when the operation can't be completed at compile time, in which case the state
+// is left wherever the evaluation stopped.
+template <typename Cell> struct PrefixEvaluator
+{
+    using Value = typename Cell::Value;
+
+    static constexpr Int64 MaxCells = MaxTapeBytes / Cell::Bytes;
+
+    // The output written from `Begin` on was written once the first `Reach` cells of the tape had been reached.
+    struct OutputChunk
+    {
+        Int64 Reach = 0;
+        std::size_t Begin = 0;
+    };
+
+    UInt64 Steps = 0;
+    Vector<Value> Cells = Vector<Value>(1);
+    Int64 Pointer = 0;
+    Vector<CharType> Output;
+    Vector<OutputChunk> Chunks;
+
+    Boolean EvaluateOperations(const Program &operations)
+    {
+        for (const auto &operation : operations)
+        {
+            if (!Evaluate(operation))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Boolean Evaluate(const Operation &operation)
+    {
+        if (!Steps)
+        {
+            return false;
+        }
+        --Steps;
+
+        switch (operation.Kind)
+        {
+        case OperationKind::AddCell:
+            if (const auto cell = Access(operation.Offset))
+            {
+                *cell = static_cast<Value>(*cell + static_cast<UInt64>(operation.Value));
+                return true;
+            }
+            return false;
+        case OperationKind::SetCell:
+            if (const auto cell = Access(operation.Offset))
+            {
+                *cell = static_cast<Value>(operation.Value);
+                return true;
+            }
+            return false;
+        case OperationKind::MovePtr:
+            return Move(operation.Value);
+        case OperationKind::Loop:
+            while (Cells[Pointer] != 0)
+            {
+                if (!EvaluateOperations(operation.Body) || !Steps--)
+                {
+                    return false;
+                }
+            }
+            return true;
+        case OperationKind::MultiplyLoop:
+            return EvaluateMultiplyLoop(operation.Body);
+        case OperationKind::ScanLoop:
+            while (Cells[Pointer] != 0)
+            {
+                if (!Move(operation.Value) || !Steps--)
+                {
+                    return false;
+                }
+            }
+            return true;
+        case OperationKind::WriteChar:
+            if (const auto cell = Access(operation.Offset); cell && Output.size() < MaxOutputBytes)
+            {
+                const auto reach = static_cast<Int64>(Cells.size());
+                if (Chunks.empty() || Chunks.back().Reach != reach)
+                {
+                    Chunks.push_back(OutputChunk{.Reach = reach, .Begin = Output.size()});
+                }
+                Output.push_back(static_cast<CharType>(*cell));
+                return true;
+            }
+            return false;
+        case OperationKind::MultiplyAdd:
+        case OperationKind::ReadChar:
+        case OperationKind::StoreBlock:
+        case OperationKind::WriteBlock:
+            return false;
+        }
+
+        return false;
+    }
+
+    // Forgets the output written past `size` characters.
+    void TruncateOutput(std::size_t size)
+    {
+        Output.resize(size);
+        while (!Chunks.empty() && Chunks.back().Begin >= size)
+        {
+            Chunks.pop_back();
+        }
+    }
+
+    // Accesses off the kept part of the tape are left to the compiled program, which reports them. Returns the cell
+    // `offset` cells away from the current one, valid until the next access.
+    Value *Access(Int64 offset)
+    {
+        if (offset < -Pointer || offset >= MaxCells - Pointer)
+        {
+            return nullptr;
+        }
+
+        const auto index = static_cast<std::size_t>(Pointer + offset);
+        if (index >= Cells.size())
+        {
+            Cells.resize(index + 1);
+        }
+
+        return &Cells[index];
+    }
+
+    Boolean Move(Int64 distance)
+    {
+        if (!Access(distance))
+        {
+            return false;
+        }
+
+        Pointer += distance;
+        return true;
+    }
+
+    // Targets are sorted by offset, and the loop would have visited every one of them.
+    Boolean EvaluateMultiplyLoop(const Program &body)
+    {
+        assert(!body.empty());
+
+        const auto counter = static_cast<UInt64>(Cells[Pointer]);
+        if (counter == 0)
+        {
+            return true;
+        }
+
+        if (!Access(body.front().Offset) || !Access(body.back().Offset))
+        {
+            return false;
+        }
+
+        for (const auto &operation : body)
+        {
+            auto &target = Cells[static_cast<std::size_t>(Pointer + operation.Offset)];
+            target = static_cast<Value>(target + counter * static_cast<UInt64>(operation.Value));
+        }
+
+        Cells[Pointer] = 0;
+        return true;
+    }
+};
+} // namespace
+
+template <typename Cell> void ir::EvaluatePrefix(Program &program, UInt64 steps)
+{
+    auto evaluator = PrefixEvaluator<Cell>{.Steps = steps};
+
+    // Only loops may stop half way, so the state they started with is kept in order to roll them back.
+    std::size_t evaluated = 0;
+    for (; evaluated < program.size(); ++evaluated)
+    {
+        const auto &operation = program[evaluated];
+        if (operation.Kind != OperationKind::Loop && operation.Kind != OperationKind::MultiplyLoop &&
+            operation.Kind != OperationKind::ScanLoop)
+        {
+            if (!evaluator.Evaluate(operation))
+            {
+                break;
+            }
+            continue;
+        }
+
+        const auto cells = evaluator.Cells;
+        const auto pointer = evaluator.Pointer;
+        const auto outputSize = evaluator.Output.size();
+        if (!evaluator.Evaluate(operation))
+        {
+            evaluator.Cells = cells;
+            evaluator.Pointer = pointer;
+            evaluator.TruncateOutput(outputSize);
+            break;
+        }
+    }
+
+    if (!evaluated)
+    {
+        return;
+    }
+
+    // Every piece of output is written once the cells reached before it are checked, so that a tape too small for the
+    // whole prefix gets the output the program would have written before running off it.
+    Program residual;
+    const auto &output = evaluator.Output;
+    const auto &chunks = evaluator.Chunks;
+    for (std::size_t index = 0; index < chunks.size(); ++index)
+    {
+        const auto begin = output.begin() + static_cast<std::ptrdiff_t>(chunks[index].Begin);
+        const auto end = index + 1 < chunks.size() ? output.begin() + static_cast<std::ptrdiff_t>(chunks[index + 1].Begin)
+                                                   : output.end();
+        residual.push_back(Operation{.Kind = OperationKind::StoreBlock, .Value = chunks[index].Reach});
+        residual.push_back(Operation{.Kind = OperationKind::WriteBlock, .Data = Vector<CharType>(begin, end)});
+    }
+
+    // Every cell the prefix has reached gets checked, even though only those up to the last non-zero one are stored.
+    auto &cells = evaluator.Cells;
+    const auto reach = static_cast<Int64>(cells.size());
+    while (!cells.empty() && cells.back() == 0)
+    {
+        cells.pop_back();
+    }
+
+    auto store = Operation{.Kind = OperationKind::StoreBlock, .Value = reach};
+    store.Data.resize(cells.size() * sizeof(typename Cell::Value));
+    if (!cells.empty())
+    {
+        std::memcpy(store.Data.data(), cells.data(), store.Data.size());
+    }
+    residual.push_back(std::move(store));
+
+    if (evaluator.Pointer)
+    {
+        residual.push_back(Operation{.Kind = OperationKind::MovePtr, .Value = evaluator.Pointer});
+    }
+
+    for (auto index = evaluated; index < program.size(); ++index)
+    {
+        residual.push_back(std::move(program[index]));
+    }
+
+    // The move is folded into the operations following it, like every other one.
+    DeferPointerMoves(residual);
+    program = std::move(residual);
+}
+
+template void ir::EvaluatePrefix<Cell8>(Program &program, UInt64 steps);
+template void ir::EvaluatePrefix<Cell16>(Program &program, UInt64 steps);
+template void ir::EvaluatePrefix<Cell32>(Program &program, UInt64 steps);
+template void ir::EvaluatePrefix<Cell64>(Program &program, UInt64 steps);
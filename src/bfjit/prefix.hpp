@@ -0,0 +1,19 @@
+#ifndef BFJIT_PREFIX_HPP
+#define BFJIT_PREFIX_HPP
+
+#include "ir.hpp"
+
+namespace bfjit
+{
+namespace ir
+{
+// Runs the program at compile time on a zeroed tape, one top-level operation after another, and replaces the
+// operations which completed with `WriteBlock`s of the output they've produced, each preceded by a check of the cells
+// reached before it was written, a `StoreBlock` of the cells they've left behind, and a move to where they've left
+// the pointer, folded into the operations following it. Evaluation stops before the first operation which reads
+// input, runs out of the `steps` budget, or leaves the part of the tape the evaluator keeps.
+template <typename Cell> void EvaluatePrefix(Program &program, UInt64 steps);
+} // namespace ir
+} // namespace bfjit
+
+#endif // BFJIT_PREFIX_HPP
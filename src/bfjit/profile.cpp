@@ -0,0 +1,130 @@
+#include "profile.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cassert>
+
+using namespace bfjit;
+
+namespace
+{
+constexpr inline std::size_t MaxBodyLength = 60;
+constexpr inline StringRef CommandCharacters = "+-<>[].,";
+
+void CollectLoops(const ir::Program &program, Vector<LoopCounters> &loops)
+{
+    for (const auto &operation : program)
+    {
+        switch (operation.Kind)
+        {
+        case ir::OperationKind::Loop:
+            loops.push_back(LoopCounters{.Kind = operation.Kind, .Position = operation.Position});
+            CollectLoops(operation.Body, loops);
+            break;
+        case ir::OperationKind::MultiplyLoop:
+        case ir::OperationKind::ScanLoop:
+            loops.push_back(LoopCounters{.Kind = operation.Kind, .Position = operation.Position});
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+StringRef KindName(ir::OperationKind kind)
+{
+    switch (kind)
+    {
+    case ir::OperationKind::MultiplyLoop:
+        return "multiply";
+    case ir::OperationKind::ScanLoop:
+        return "scan";
+    default:
+        return "loop";
+    }
+}
+
+// The source text between the brackets of a loop, with whitespace runs collapsed.
+String LoopBody(StringRef source, std::size_t first, std::size_t last)
+{
+    String body;
+    for (auto index = first; index <= last && index < source.size(); ++index)
+    {
+        const auto character = source[index];
+        const auto isSpace = character == ' ' || character == '\t' || character == '\n' || character == '\r';
+        if (!isSpace)
+        {
+            body.push_back(character);
+        }
+        else if (!body.empty() && body.back() != ' ')
+        {
+            body.push_back(' ');
+        }
+
+        if (body.size() > MaxBodyLength)
+        {
+            body.resize(MaxBodyLength - 3);
+            body.append("...");
+            break;
+        }
+    }
+
+    return body;
+}
+} // namespace
+
+void LoopProfile::Reset(const ir::Program &program)
+{
+    Loops.clear();
+    CollectLoops(program, Loops);
+}
+
+void bfjit::PrintLoopProfile(std::FILE *file, const LoopProfile &profile, StringRef source,
+                             const Vector<Instruction> &instructions, std::size_t limit)
+{
+    assert(file);
+
+    // Instruction positions are mapped back to source offsets, and opening brackets to their closing ones.
+    Vector<std::size_t> sourceOffsets;
+    sourceOffsets.reserve(instructions.size());
+    for (std::size_t offset = 0; offset < source.size(); ++offset)
+    {
+        if (CommandCharacters.find(source[offset]) != StringRef::npos)
+        {
+            sourceOffsets.push_back(offset);
+        }
+    }
+
+    Vector<std::size_t> matchingPositions(instructions.size());
+    Vector<std::size_t> openPositions;
+    for (std::size_t position = 0; position < instructions.size(); ++position)
+    {
+        if (instructions[position] == Instruction::Jz)
+        {
+            openPositions.push_back(position);
+        }
+        else if (instructions[position] == Instruction::Jnz && !openPositions.empty())
+        {
+            matchingPositions[openPositions.back()] = position;
+            openPositions.pop_back();
+        }
+    }
+
+    auto loops = profile.Loops;
+    std::stable_sort(loops.begin(), loops.end(), [](const auto &left, const auto &right) {
+        return left.Iterations != right.Iterations ? left.Iterations > right.Iterations : left.Entries > right.Entries;
+    });
+    loops.resize(std::min(loops.size(), limit));
+
+    fmt::print(file, "{:>10} {:<8} {:>14} {:>14}  {}\n", "offset", "kind", "entries", "iterations", "body");
+    for (const auto &loop : loops)
+    {
+        const auto position = static_cast<std::size_t>(loop.Position);
+        const auto isMapped = position < sourceOffsets.size() && matchingPositions[position] < sourceOffsets.size();
+        const auto first = isMapped ? sourceOffsets[position] : 0;
+        const auto body = isMapped ? LoopBody(source, first, sourceOffsets[matchingPositions[position]]) : String();
+        fmt::print(file, "{:>10} {:<8} {:>14} {:>14}  {}\n", first, KindName(loop.Kind), loop.Entries,
+                   loop.Iterations, body);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef BFJIT_PROFILE_HPP
+#define BFJIT_PROFILE_HPP
+
+#include "ir.hpp"
+#include "types.hpp"
+
+#include <cstdio>
+
+namespace bfjit
+{
+// `Entries` counts how many times the loop was reached, `Iterations` how many times its body ran. Loops lowered to
+// multiply or scan loops don't run their bodies one by one, so only their entries are counted.
+struct LoopCounters
+{
+    ir::OperationKind Kind;
+    Int64 Position = 0;
+    UInt64 Entries = 0;
+    UInt64 Iterations = 0;
+};
+
+// The running program updates the counters in place, so `Loops` must not be reallocated once the program has been
+// compiled. Backends instrument loops in the order `Reset` lists them in, which is the order they appear in.
+struct LoopProfile
+{
+    Vector<LoopCounters> Loops;
+
+    void Reset(const ir::Program &program);
+};
+
+// Prints the `limit` loops which ran the most iterations, along with their source text.
+void PrintLoopProfile(std::FILE *file, const LoopProfile &profile, StringRef source,
+                      const Vector<Instruction> &instructions, std::size_t limit);
+} // namespace bfjit
+
+#endif // BFJIT_PROFILE_HPP
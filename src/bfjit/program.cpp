@@ -0,0 +1,56 @@
+#include "program.hpp"
+#include "exception.hpp"
+#include "instruction.hpp"
+#include "lexer.hpp"
+
+#include <cassert>
+
+using namespace bfjit;
+
+namespace
+{
+Entrypoint CompileSource(CompilerBackend &backend, StringRef source, UInt32 guardSize, UInt32 cellBits)
+{
+    const auto instructions = LexInstructions(source);
+    SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+
+    return backend.Compile(CompilerContext{.Reader = &reader, .GuardSize = guardSize, .CellBits = cellBits});
+}
+} // namespace
+
+CompiledProgram::CompiledProgram(CompilerBackend &backend, const CompilerContext &context)
+    : m_entrypoint(backend.Compile(context)), m_guardSize(context.GuardSize), m_cellBits(context.CellBits)
+{
+    assert(m_entrypoint);
+}
+
+CompiledProgram::CompiledProgram(CompilerBackend &backend, StringRef source, UInt32 guardSize, UInt32 cellBits)
+    : m_entrypoint(CompileSource(backend, source, guardSize, cellBits)), m_guardSize(guardSize), m_cellBits(cellBits)
+{
+    assert(m_entrypoint);
+}
+
+UInt32 CompiledProgram::GuardSize() const noexcept
+{
+    return m_guardSize;
+}
+
+UInt32 CompiledProgram::CellBits() const noexcept
+{
+    return m_cellBits;
+}
+
+Result CompiledProgram::Run(Tape &tape, OutputBuffer &output, InputBuffer &input) const
+{
+    // Unchecked accesses would run past the guard regions of the tape.
+    if (tape.GuardSize() < m_guardSize)
+    {
+        throw Exception::Formatted("program compiled for guard size {} can't run on a tape with guard size {}",
+                                   m_guardSize, tape.GuardSize());
+    }
+
+    const auto cellBytes = static_cast<Int64>(m_cellBits / 8);
+    return tape.Execute([&](CharPtr begin, CharPtr end) {
+        return m_entrypoint(begin, begin + (end - begin) / cellBytes * cellBytes, &output, &input);
+    });
+}
@@ -0,0 +1,37 @@
+#ifndef BFJIT_PROGRAM_HPP
+#define BFJIT_PROGRAM_HPP
+
+#include "tape.hpp"
+#include "types.hpp"
+
+namespace bfjit
+{
+// A compiled program owning its code, which stays valid after the backend compiling it is destroyed. It can be run any
+// number of times, on any tape with a guard size at least as large as the one it was compiled for. The tape has to be
+// zeroed, either fresh or cleared with `Tape::Clear`, since loops the program can't enter on a zeroed tape and the code
+// the prefix evaluation ran have been compiled away. Programs compiled by a tiered or lazy compiler or with a profile
+// must not be run by several threads at once. Programs with cells wider than a byte only use the part of the tape
+// holding whole cells. Programs compiled by a tiered or lazy `MirCompiler` keep a code generator, along with its
+// thread, for as long as they live.
+class CompiledProgram
+{
+public:
+    CompiledProgram(CompilerBackend &backend, const CompilerContext &context);
+
+    // Compiles `source` for tapes with the given guard size and cells of the given width.
+    CompiledProgram(CompilerBackend &backend, StringRef source, UInt32 guardSize = 0, UInt32 cellBits = 8);
+
+    UInt32 GuardSize() const noexcept;
+
+    UInt32 CellBits() const noexcept;
+
+    Result Run(Tape &tape, OutputBuffer &output, InputBuffer &input) const;
+
+private:
+    Entrypoint m_entrypoint;
+    UInt32 m_guardSize;
+    UInt32 m_cellBits;
+};
+} // namespace bfjit
+
+#endif // BFJIT_PROGRAM_HPP
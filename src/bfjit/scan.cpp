@@ -0,0 +1,247 @@
+#include "scan.hpp"
+#include "cell.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BFJIT_SCAN_SIMD 1
+#endif
+
+using namespace bfjit;
+
+namespace
+{
+using ScanFunc = CharPtr (*)(CharPtr, CharPtr, Int64);
+
+template <typename Cell> Boolean IsZeroCell(const CharType *data) noexcept
+{
+    return *reinterpret_cast<const typename Cell::Value *>(data) == 0;
+}
+
+template <typename Cell> CharPtr ScanForwardScalar(CharPtr current, CharPtr end, Int64 stride)
+{
+    const auto step = stride * Cell::Bytes;
+    for (Int64 index = 0; index < end - current; index += step)
+    {
+        if (IsZeroCell<Cell>(current + index))
+        {
+            return current + index;
+        }
+    }
+
+    return nullptr;
+}
+
+template <typename Cell> CharPtr ScanBackwardScalar(CharPtr current, CharPtr begin, Int64 stride)
+{
+    const auto step = stride * Cell::Bytes;
+    for (Int64 index = 0; index <= current - begin; index += step)
+    {
+        if (IsZeroCell<Cell>(current - index))
+        {
+            return current - index;
+        }
+    }
+
+    return nullptr;
+}
+
+#ifdef BFJIT_SCAN_SIMD
+struct Sse2Block
+{
+    static constexpr Int64 Width = 16;
+
+    static UInt32 ZeroMask(const CharType *data)
+    {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        return static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())));
+    }
+};
+
+struct Avx2Block
+{
+    static constexpr Int64 Width = 32;
+
+    [[gnu::target("avx2")]] static UInt32 ZeroMask(const CharType *data)
+    {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        return static_cast<UInt32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_setzero_si256())));
+    }
+};
+
+// Turns a mask of zero bytes into one where bit `i` is set when the cell starting at byte `i` is zero.
+template <typename Cell> UInt32 CellZeroMask(UInt32 mask) noexcept
+{
+    for (Int64 width = 1; width < Cell::Bytes; width *= 2)
+    {
+        mask &= mask >> width;
+    }
+
+    return mask;
+}
+
+// Bit `i` is set when the `i`-th byte of a block starting at a candidate cell is a candidate as well.
+UInt32 StridePattern(Int64 stride, Int64 width)
+{
+    UInt32 pattern = 0;
+    for (Int64 index = 0; index < width; index += stride)
+    {
+        pattern |= UInt32(1) << index;
+    }
+
+    return pattern;
+}
+
+// Candidates are `shift` bytes into the current block; the next block starts `width % stride` bytes further into
+// the stride pattern.
+UInt32 NextShift(UInt32 shift, Int64 stride, Int64 width)
+{
+    const auto advance = static_cast<UInt32>(width % stride);
+    return shift >= advance ? shift - advance : shift + static_cast<UInt32>(stride) - advance;
+}
+
+// Blocks hold whole cells, since their width is a multiple of any cell size, so candidates never straddle two blocks.
+template <typename Cell, typename Block> CharPtr ScanForwardBlocks(CharPtr current, CharPtr end, Int64 stride)
+{
+    const auto step = stride * Cell::Bytes;
+    assert(step < Block::Width);
+
+    const auto pattern = StridePattern(step, Block::Width);
+    UInt32 shift = 0;
+    for (; end - current >= Block::Width; current += Block::Width)
+    {
+        const auto mask = CellZeroMask<Cell>(Block::ZeroMask(current)) & (pattern << shift);
+        if (mask)
+        {
+            return current + __builtin_ctz(mask);
+        }
+
+        shift = NextShift(shift, step, Block::Width);
+    }
+
+    return ScanForwardScalar<Cell>(current + shift, end, stride);
+}
+
+template <typename Cell, typename Block> CharPtr ScanBackwardBlocks(CharPtr current, CharPtr begin, Int64 stride)
+{
+    const auto step = stride * Cell::Bytes;
+    assert(step < Block::Width);
+
+    // Blocks are walked downwards starting right past the current cell, so candidates are counted from the top one.
+    UInt32 pattern = 0;
+    for (Int64 index = Block::Width - Cell::Bytes; index >= 0; index -= step)
+    {
+        pattern |= UInt32(1) << index;
+    }
+
+    auto top = current + Cell::Bytes;
+    UInt32 shift = 0;
+    for (; top - begin >= Block::Width; top -= Block::Width)
+    {
+        const auto mask = CellZeroMask<Cell>(Block::ZeroMask(top - Block::Width)) & (pattern >> shift);
+        if (mask)
+        {
+            return top - Block::Width + (31 - __builtin_clz(mask));
+        }
+
+        shift = NextShift(shift, step, Block::Width);
+    }
+
+    return ScanBackwardScalar<Cell>(top - Cell::Bytes - shift, begin, stride);
+}
+
+template <typename Cell> CharPtr ScanForwardSse2(CharPtr current, CharPtr end, Int64 stride)
+{
+    return ScanForwardBlocks<Cell, Sse2Block>(current, end, stride);
+}
+
+template <typename Cell> CharPtr ScanBackwardSse2(CharPtr current, CharPtr begin, Int64 stride)
+{
+    return ScanBackwardBlocks<Cell, Sse2Block>(current, begin, stride);
+}
+
+// Flattening inlines the generic block loop into the AVX2-enabled function, so the vector code never leaves it.
+template <typename Cell>
+[[gnu::target("avx2"), gnu::flatten]] CharPtr ScanForwardAvx2(CharPtr current, CharPtr end, Int64 stride)
+{
+    return ScanForwardBlocks<Cell, Avx2Block>(current, end, stride);
+}
+
+template <typename Cell>
+[[gnu::target("avx2"), gnu::flatten]] CharPtr ScanBackwardAvx2(CharPtr current, CharPtr begin, Int64 stride)
+{
+    return ScanBackwardBlocks<Cell, Avx2Block>(current, begin, stride);
+}
+
+template <typename Cell> struct ScanKernels
+{
+    ScanFunc Forward;
+    ScanFunc Backward;
+    Int64 Width;
+
+    static ScanKernels Select() noexcept
+    {
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return ScanKernels{
+                .Forward = ScanForwardAvx2<Cell>, .Backward = ScanBackwardAvx2<Cell>, .Width = Avx2Block::Width};
+        }
+
+        return ScanKernels{
+            .Forward = ScanForwardSse2<Cell>, .Backward = ScanBackwardSse2<Cell>, .Width = Sse2Block::Width};
+    }
+};
+
+template <typename Cell> const ScanKernels<Cell> Kernels = ScanKernels<Cell>::Select();
+#endif
+} // namespace
+
+template <typename Cell> CharPtr bfjit::ScanForward(CharPtr current, CharPtr end, Int64 stride)
+{
+    assert(stride > 0);
+
+    if (Cell::Bytes == 1 && stride == 1)
+    {
+        return static_cast<CharPtr>(std::memchr(current, 0, end - current));
+    }
+
+#ifdef BFJIT_SCAN_SIMD
+    if (stride < Kernels<Cell>.Width / Cell::Bytes)
+    {
+        return Kernels<Cell>.Forward(current, end, stride);
+    }
+#endif
+
+    return ScanForwardScalar<Cell>(current, end, stride);
+}
+
+template <typename Cell> CharPtr bfjit::ScanBackward(CharPtr current, CharPtr begin, Int64 stride)
+{
+    assert(stride > 0);
+
+    if (Cell::Bytes == 1 && stride == 1)
+    {
+        return static_cast<CharPtr>(memrchr(begin, 0, current - begin + 1));
+    }
+
+#ifdef BFJIT_SCAN_SIMD
+    if (stride < Kernels<Cell>.Width / Cell::Bytes)
+    {
+        return Kernels<Cell>.Backward(current, begin, stride);
+    }
+#endif
+
+    return ScanBackwardScalar<Cell>(current, begin, stride);
+}
+
+template CharPtr bfjit::ScanForward<Cell8>(CharPtr current, CharPtr end, Int64 stride);
+template CharPtr bfjit::ScanForward<Cell16>(CharPtr current, CharPtr end, Int64 stride);
+template CharPtr bfjit::ScanForward<Cell32>(CharPtr current, CharPtr end, Int64 stride);
+template CharPtr bfjit::ScanForward<Cell64>(CharPtr current, CharPtr end, Int64 stride);
+
+template CharPtr bfjit::ScanBackward<Cell8>(CharPtr current, CharPtr begin, Int64 stride);
+template CharPtr bfjit::ScanBackward<Cell16>(CharPtr current, CharPtr begin, Int64 stride);
+template CharPtr bfjit::ScanBackward<Cell32>(CharPtr current, CharPtr begin, Int64 stride);
+template CharPtr bfjit::ScanBackward<Cell64>(CharPtr current, CharPtr begin, Int64 stride);
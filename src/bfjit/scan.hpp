@@ -0,0 +1,18 @@
+#ifndef BFJIT_SCAN_HPP
+#define BFJIT_SCAN_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+// Returns the first zero cell among `current`, `current + stride`, ... lying below `end`, or null if there's none.
+// Cells are described by the policy `Cell`, and `stride` counts them rather than bytes. The tape bounds must lie on
+// cell boundaries relative to `current`.
+template <typename Cell> CharPtr ScanForward(CharPtr current, CharPtr end, Int64 stride);
+
+// Returns the first zero cell among `current`, `current - stride`, ... not lying below `begin`, or null if there's
+// none.
+template <typename Cell> CharPtr ScanBackward(CharPtr current, CharPtr begin, Int64 stride);
+} // namespace bfjit
+
+#endif // BFJIT_SCAN_HPP
@@ -0,0 +1,43 @@
+#ifndef BFJIT_STATISTICS_HPP
+#define BFJIT_STATISTICS_HPP
+
+#include "types.hpp"
+
+#include <chrono>
+
+namespace bfjit
+{
+// Filled in by backends when requested through `CompilerContext`. Phases a backend doesn't have are left at zero, as
+// are the MIR counts of programs loaded from the cache. Times are in seconds. `LoadSeconds` covers loading modules and
+// their imports, while `GenerateSeconds` covers linking them, which generates their code, and `CodeBytes` the code
+// generated then.
+struct CompilerStatistics
+{
+    double BuildSeconds = 0;
+    double EmitSeconds = 0;
+    double LoadSeconds = 0;
+    double GenerateSeconds = 0;
+    UInt64 MirInstructions = 0;
+    UInt64 MirRegisters = 0;
+    UInt64 MirLabels = 0;
+    UInt64 CodeBytes = 0;
+};
+
+class Stopwatch
+{
+public:
+    Stopwatch() noexcept : m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    double ElapsedSeconds() const noexcept
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+} // namespace bfjit
+
+#endif // BFJIT_STATISTICS_HPP
@@ -0,0 +1,283 @@
+#include "tape.hpp"
+#include "exception.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace bfjit;
+
+namespace
+{
+struct GuardedExecution
+{
+    sigjmp_buf Jump;
+    CharPtr LowGuard;
+    CharPtr Begin;
+    CharPtr *Committed;
+    CharPtr Reserved;
+    CharPtr HighGuard;
+};
+
+thread_local GuardedExecution *ActiveExecution = nullptr;
+struct sigaction PreviousSegvAction;
+
+// Queried up front, since `sysconf` isn't safe to call from the fault handler.
+const auto PageSize = static_cast<UInt64>(sysconf(_SC_PAGESIZE));
+
+UInt64 RoundToPageSize(UInt64 size)
+{
+    return (size + PageSize - 1) / PageSize * PageSize;
+}
+
+// Commits at least up to the page holding `address`, and at least doubles the committed part, so that a program
+// walking along the tape faults a logarithmic number of times.
+Boolean GrowTape(const GuardedExecution &execution, CharPtr address) noexcept
+{
+    const auto committedSize = static_cast<UInt64>(*execution.Committed - execution.Begin);
+    const auto reservedSize = static_cast<UInt64>(execution.Reserved - execution.Begin);
+    const auto requiredSize = RoundToPageSize(static_cast<UInt64>(address - execution.Begin) + 1);
+    const auto newSize = std::min(std::max(requiredSize, 2 * committedSize), reservedSize);
+    if (mprotect(*execution.Committed, newSize - committedSize, PROT_READ | PROT_WRITE) != 0)
+    {
+        return false;
+    }
+
+    *execution.Committed = execution.Begin + newSize;
+    return true;
+}
+
+void HandleSegmentationFault(int signal, siginfo_t *info, void *context)
+{
+    const auto execution = ActiveExecution;
+    const auto address = static_cast<CharPtr>(info->si_addr);
+    if (execution && address >= execution->LowGuard && address < execution->Begin)
+    {
+        siglongjmp(execution->Jump, static_cast<int>(Result::MemoryUnderrun));
+    }
+
+    // Returning restarts the faulting instruction, which now finds the memory accessible.
+    if (execution && address >= *execution->Committed && address < execution->Reserved)
+    {
+        if (GrowTape(*execution, address))
+        {
+            return;
+        }
+
+        siglongjmp(execution->Jump, static_cast<int>(Result::OutOfMemory));
+    }
+
+    if (execution && address >= execution->Reserved && address < execution->HighGuard)
+    {
+        siglongjmp(execution->Jump, static_cast<int>(Result::OutOfMemory));
+    }
+
+    // Not a tape fault: hand it over to whoever was handling it before, or let the default action kill the process
+    // once the faulting instruction is restarted.
+    if (PreviousSegvAction.sa_flags & SA_SIGINFO)
+    {
+        PreviousSegvAction.sa_sigaction(signal, info, context);
+    }
+    else if (PreviousSegvAction.sa_handler != SIG_DFL && PreviousSegvAction.sa_handler != SIG_IGN)
+    {
+        PreviousSegvAction.sa_handler(signal);
+    }
+    else
+    {
+        std::signal(SIGSEGV, SIG_DFL);
+    }
+}
+
+void InstallSegmentationFaultHandler()
+{
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        struct sigaction action = {};
+        action.sa_sigaction = HandleSegmentationFault;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGSEGV, &action, &PreviousSegvAction) != 0)
+        {
+            throw Exception::Formatted("failed to install tape fault handler: {}", std::strerror(errno));
+        }
+    });
+}
+} // namespace
+
+// The mapping holds the low guard, the reserved range and the high guard. Only the committed start of the reserved
+// range is accessible, and the kernel backs its pages with memory once they're first touched. An unguarded tape
+// which can't grow is exactly `Size` bytes long, even though its mapping is rounded up to the page size.
+struct Tape::Impl
+{
+    CharPtr Mapping = nullptr;
+    UInt64 MappingSize = 0;
+    UInt32 GuardSize = 0;
+    UInt64 Size = 0;
+    UInt64 ReservedSize = 0;
+    UInt64 InitialCommittedSize = 0;
+    CharPtr Committed = nullptr;
+
+    explicit Impl(const TapeOptions &options)
+    {
+        const auto size = std::max(options.Size, options.MaxSize);
+        if (size > std::numeric_limits<UInt64>::max() / 2)
+        {
+            throw Exception::Formatted("tape size {} is too large", size);
+        }
+
+        GuardSize = static_cast<UInt32>(RoundToPageSize(options.GuardSize));
+        Size = GuardSize ? RoundToPageSize(size) : size;
+        ReservedSize = std::max(RoundToPageSize(size), PageSize);
+        MappingSize = ReservedSize + 2 * static_cast<UInt64>(GuardSize);
+
+        const auto mapping = mmap(nullptr, MappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            throw Exception::Formatted("failed to map tape: {}", std::strerror(errno));
+        }
+
+        Mapping = static_cast<CharPtr>(mapping);
+        InitialCommittedSize = std::min(RoundToPageSize(options.Size), ReservedSize);
+        Committed = Begin() + InitialCommittedSize;
+        if (Committed > Begin() && mprotect(Begin(), Committed - Begin(), PROT_READ | PROT_WRITE) != 0)
+        {
+            munmap(Mapping, MappingSize);
+            throw Exception::Formatted("failed to map tape: {}", std::strerror(errno));
+        }
+
+        // Only advice: kernels without transparent huge pages simply keep using small ones.
+        if (options.HugePages)
+        {
+            madvise(Begin(), ReservedSize, MADV_HUGEPAGE);
+        }
+
+        if (IsGuarded())
+        {
+            InstallSegmentationFaultHandler();
+        }
+    }
+
+    ~Impl()
+    {
+        munmap(Mapping, MappingSize);
+    }
+
+    // Dropping private anonymous pages makes them read as zeros again.
+    void Clear()
+    {
+        const auto initialCommitted = Begin() + InitialCommittedSize;
+        if (Committed > initialCommitted && mprotect(initialCommitted, Committed - initialCommitted, PROT_NONE) != 0)
+        {
+            throw Exception::Formatted("failed to clear tape: {}", std::strerror(errno));
+        }
+
+        Committed = initialCommitted;
+        if (madvise(Begin(), ReservedSize, MADV_DONTNEED) != 0)
+        {
+            throw Exception::Formatted("failed to clear tape: {}", std::strerror(errno));
+        }
+    }
+
+    Boolean IsGuarded() const noexcept
+    {
+        return GuardSize || Committed < Begin() + ReservedSize;
+    }
+
+    CharPtr Begin() const noexcept
+    {
+        return Mapping + GuardSize;
+    }
+
+    CharPtr End() const noexcept
+    {
+        return Begin() + Size;
+    }
+
+    Result Execute(const std::function<Result(CharPtr, CharPtr)> &function)
+    {
+        assert(function);
+
+        if (!IsGuarded())
+        {
+            return function(Begin(), End());
+        }
+
+        GuardedExecution execution{
+            .LowGuard = Mapping,
+            .Begin = Begin(),
+            .Committed = &Committed,
+            .Reserved = Begin() + ReservedSize,
+            .HighGuard = Begin() + ReservedSize + GuardSize,
+        };
+        const auto previousExecution = ActiveExecution;
+        ActiveExecution = &execution;
+        if (const auto fault = sigsetjmp(execution.Jump, 1))
+        {
+            ActiveExecution = previousExecution;
+            return static_cast<Result>(fault);
+        }
+
+        const auto result = function(Begin(), End());
+        ActiveExecution = previousExecution;
+
+        return result;
+    }
+};
+
+Tape::Tape(const TapeOptions &options) : m_impl(std::make_unique<Impl>(options))
+{
+}
+
+Tape::~Tape()
+{
+}
+
+CharPtr Tape::Begin() const noexcept
+{
+    assert(m_impl);
+
+    return m_impl->Begin();
+}
+
+CharPtr Tape::End() const noexcept
+{
+    assert(m_impl);
+
+    return m_impl->End();
+}
+
+UInt32 Tape::GuardSize() const noexcept
+{
+    assert(m_impl);
+
+    return m_impl->GuardSize;
+}
+
+UInt64 Tape::CommittedSize() const noexcept
+{
+    assert(m_impl);
+
+    return static_cast<UInt64>(m_impl->Committed - m_impl->Begin());
+}
+
+Result Tape::Execute(const std::function<Result(CharPtr, CharPtr)> &function)
+{
+    assert(m_impl);
+
+    return m_impl->Execute(function);
+}
+
+void Tape::Clear()
+{
+    assert(m_impl);
+
+    m_impl->Clear();
+}
@@ -0,0 +1,53 @@
+#ifndef BFJIT_TAPE_HPP
+#define BFJIT_TAPE_HPP
+
+#include "types.hpp"
+
+#include <functional>
+#include <memory>
+
+namespace bfjit
+{
+// `Size` bytes are available to the program from the start. When `MaxSize` is larger, the tape reserves that much
+// address space and grows towards it whenever the program runs past the part committed so far. Pages only take up
+// memory once they're touched, and `HugePages` asks for them to be backed by transparent huge pages.
+struct TapeOptions
+{
+    UInt64 Size = 1 << 20;
+    UInt64 MaxSize = 0;
+    UInt32 GuardSize = 0;
+    Boolean HugePages = false;
+};
+
+// The memory the brainfuck program operates on. A tape with a non-zero guard size is surrounded by inaccessible
+// regions of at least that many bytes, and faults inside them are reported as `MemoryUnderrun`/`OutOfMemory` by
+// `Execute` instead of crashing the process. Both sizes of a guarded tape are rounded up to the page size. `End`
+// is the end of the whole reserved range, the part of which beyond `CommittedSize` is committed by `Execute` as the
+// program touches it.
+class Tape
+{
+public:
+    explicit Tape(const TapeOptions &options);
+
+    ~Tape();
+
+    CharPtr Begin() const noexcept;
+
+    CharPtr End() const noexcept;
+
+    UInt32 GuardSize() const noexcept;
+
+    UInt64 CommittedSize() const noexcept;
+
+    Result Execute(const std::function<Result(CharPtr, CharPtr)> &function);
+
+    // Zeroes the tape and gives back the memory it grew by, so that it can run another program.
+    void Clear();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+} // namespace bfjit
+
+#endif // BFJIT_TAPE_HPP
@@ -0,0 +1,574 @@
+#include "exception.hpp"
+#include "interpreter.hpp"
+#include "io.hpp"
+#include "lexer.hpp"
+#include "mir_compiler.hpp"
+#include "program.hpp"
+#include "tape.hpp"
+#include "x64_compiler.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifndef BFJIT_TEST_CORPUS
+#define BFJIT_TEST_CORPUS "bench/corpus"
+#endif
+
+using namespace bfjit;
+
+namespace
+{
+// The expected outcome is written down by hand, or read from the `.out` file next to a corpus program, rather than
+// taken from one of the backends, since they all run the program through the same IR passes. Corpus programs count
+// down from the maximum cell value, so they only finish in reasonable time on 8-bit cells. Unguarded tapes are
+// exactly `HeapSize` bytes long while guarded ones are rounded up to the page size, so cases with a heap that isn't a
+// multiple of it only run unguarded.
+struct TestCase
+{
+    String Name;
+    String Source;
+    String Input;
+    UInt64 HeapSize = 1 << 16;
+    Vector<UInt32> CellBits = {8, 16, 32, 64};
+    Result ExpectedStatus = Result::Success;
+    String ExpectedOutput;
+};
+
+struct Configuration
+{
+    String Backend;
+    UInt32 CellBits = 8;
+    UInt32 GuardSize = 0;
+    UInt64 PrefixSteps = 0;
+};
+
+struct Outcome
+{
+    Result Status = Result::Success;
+    String Output;
+
+    Boolean operator==(const Outcome &) const = default;
+};
+
+// Keeps the whole output in memory. The buffer is tiny, so that the generated code flushes it all the time.
+class MemoryOutputBuffer final : public OutputBuffer
+{
+public:
+    MemoryOutputBuffer() : OutputBuffer{}
+    {
+        Cursor = m_storage.data();
+        Limit = m_storage.data() + m_storage.size();
+        Flush = FlushBuffer;
+    }
+
+    const String &Contents()
+    {
+        FlushBuffer(this);
+        return m_contents;
+    }
+
+private:
+    static Result FlushBuffer(OutputBuffer *buffer)
+    {
+        const auto self = static_cast<MemoryOutputBuffer *>(buffer);
+        self->m_contents.append(self->m_storage.data(), self->Cursor);
+        self->Cursor = self->m_storage.data();
+        return Result::Success;
+    }
+
+    std::array<CharType, 7> m_storage = {};
+    String m_contents;
+};
+
+class Pipe
+{
+public:
+    Pipe()
+    {
+        if (pipe2(m_fds.data(), O_CLOEXEC) != 0)
+        {
+            throw Exception::Formatted("failed to create a pipe: {}", std::strerror(errno));
+        }
+    }
+
+    Pipe(const Pipe &) = delete;
+
+    Pipe &operator=(const Pipe &) = delete;
+
+    ~Pipe()
+    {
+        CloseWriteEnd();
+        close(m_fds[0]);
+    }
+
+    int ReadEnd() const noexcept
+    {
+        return m_fds[0];
+    }
+
+    int WriteEnd() const noexcept
+    {
+        return m_fds[1];
+    }
+
+    void CloseWriteEnd() noexcept
+    {
+        if (m_fds[1] >= 0)
+        {
+            close(m_fds[1]);
+            m_fds[1] = -1;
+        }
+    }
+
+private:
+    std::array<int, 2> m_fds = {-1, -1};
+};
+
+String ReadFile(const std::filesystem::path &path)
+{
+    const SourceFile file(path.string());
+    return String(file.Text());
+}
+
+Vector<TestCase> LoadCorpus(const String &directory)
+{
+    Vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".b")
+        {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    Vector<TestCase> cases;
+    for (const auto &path : paths)
+    {
+        auto inputPath = path;
+        inputPath.replace_extension(".in");
+        auto outputPath = path;
+        outputPath.replace_extension(".out");
+        cases.push_back(TestCase{
+            .Name = path.stem().string(),
+            .Source = ReadFile(path),
+            .Input = std::filesystem::exists(inputPath) ? ReadFile(inputPath) : String(),
+            .HeapSize = 1 << 20,
+            .CellBits = {8},
+            .ExpectedOutput = ReadFile(outputPath),
+        });
+    }
+
+    return cases;
+}
+
+// Programs running off either end of the tape, into the guard regions or past them, along with ones the IR passes
+// rewrite, ones telling the cell widths apart and ones the prefix evaluation can get wrong.
+Vector<TestCase> EdgeCases()
+{
+    const auto far = String(60000, '>');
+    const auto isNonZero = String("[>+<[-]]>.");
+    const auto multiplyBy256 = "[>" + String(256, '+') + "<-]>";
+    return {
+        TestCase{
+            .Name = "underrun",
+            .Source = "+.<+",
+            .ExpectedStatus = Result::MemoryUnderrun,
+            .ExpectedOutput = "\x01",
+        },
+        TestCase{
+            .Name = "underrun-in-loop",
+            .Source = "+[.<]",
+            .ExpectedStatus = Result::MemoryUnderrun,
+            .ExpectedOutput = "\x01",
+        },
+        TestCase{
+            .Name = "overrun-in-loop",
+            .Source = "+[>+]",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "overrun-past-guard",
+            .Source = far + "+.",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "underrun-past-guard",
+            .Source = "+" + String(60000, '<') + "+.",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::MemoryUnderrun,
+        },
+        TestCase{
+            .Name = "output-before-overrun",
+            .Source = "+[.>+]",
+            .HeapSize = 4096,
+            .CellBits = {8},
+            .ExpectedStatus = Result::OutOfMemory,
+            .ExpectedOutput = String(4096, '\x01'),
+        },
+        TestCase{
+            .Name = "both-ends-in-loop",
+            .Source = ">>>>+[->>[-]" + String(30, '<') + "[-]" + String(90, '>') + "[>]]",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::MemoryUnderrun,
+        },
+        TestCase{
+            .Name = "prefix-reach-past-guard",
+            .Source = far + "+[-]<[>]" + far + ",",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "prefix-output-on-small-tape",
+            .Source = ">>.----->>>>>>>+++++>++++[-]>.>>>>>>[>><<<<<<<[>>>+++++<]]+>",
+            .HeapSize = 16,
+            .CellBits = {8},
+            .ExpectedStatus = Result::OutOfMemory,
+            .ExpectedOutput = String(2, '\0'),
+        },
+        TestCase{
+            .Name = "folded-runs",
+            .Source = ">+-<<>+.",
+            .ExpectedOutput = "\x01",
+        },
+        TestCase{
+            .Name = "wrap-around",
+            .Source = "-.+.+.--[+>+<]>.",
+            .ExpectedOutput = String("\xff\x00\x01\x01", 4),
+        },
+        TestCase{
+            .Name = "multiply",
+            .Source = "+++++[>+++<-]>[>++>+++<<-]>.>.<<<+[->>>+<<<]>>>.",
+            .ExpectedOutput = "\x1e\x2d\x2e",
+        },
+        TestCase{
+            .Name = "multiply-loop-past-end",
+            .Source = String(4090, '>') + "+[->>>>>>+<<<<<<]",
+            .HeapSize = 4096,
+            .CellBits = {8},
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "multiply-loop-cancelling-past-end",
+            .Source = String(4094, '>') + "+[->>+<+>-<<]",
+            .HeapSize = 4096,
+            .CellBits = {8},
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "multiply-loop-start-first",
+            .Source = "+[-<+>>+<]",
+            .HeapSize = 1,
+            .CellBits = {8},
+            .ExpectedStatus = Result::MemoryUnderrun,
+        },
+        TestCase{
+            .Name = "multiply-loop-end-first",
+            .Source = "+[->+<<+>]",
+            .HeapSize = 1,
+            .CellBits = {8},
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "multiply-loop-start-first-past-guard",
+            .Source = "+[-" + String(60000, '<') + "+" + far + far + "+" + String(60000, '<') + "]",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::MemoryUnderrun,
+        },
+        TestCase{
+            .Name = "multiply-loop-end-first-past-guard",
+            .Source = "+[-" + far + "+" + String(120000, '<') + "+" + far + "]",
+            .HeapSize = 4096,
+            .ExpectedStatus = Result::OutOfMemory,
+        },
+        TestCase{
+            .Name = "scan-both-ways",
+            .Source = ">+>++>+++>++++>>+++++<<<<<[>]+<[<]>>>.[-]<<[<]>>[>]<.",
+            .ExpectedOutput = "\x03\x02",
+        },
+        TestCase{
+            .Name = "scan-off-start",
+            .Source = "+>+<[<]",
+            .ExpectedStatus = Result::MemoryUnderrun,
+        },
+        TestCase{
+            .Name = "8-bit-wrap",
+            .Source = String(256, '+') + isNonZero,
+            .CellBits = {8},
+            .ExpectedOutput = String(1, '\0'),
+        },
+        TestCase{
+            .Name = "no-8-bit-wrap",
+            .Source = String(256, '+') + isNonZero,
+            .CellBits = {16, 32, 64},
+            .ExpectedOutput = "\x01",
+        },
+        TestCase{
+            .Name = "16-bit-wrap",
+            .Source = String(256, '+') + multiplyBy256 + isNonZero,
+            .CellBits = {8, 16},
+            .ExpectedOutput = String(1, '\0'),
+        },
+        TestCase{
+            .Name = "no-16-bit-wrap",
+            .Source = String(256, '+') + multiplyBy256 + isNonZero,
+            .CellBits = {32, 64},
+            .ExpectedOutput = "\x01",
+        },
+        TestCase{
+            .Name = "echo",
+            .Source = ",[.,]",
+            .Input = "echo",
+            .ExpectedStatus = Result::ReadError,
+            .ExpectedOutput = "echo",
+        },
+    };
+}
+
+Vector<String> CreateBackendNames()
+{
+    Vector<String> names = {"interp", "mir", "tiered"};
+    if (X64Compiler::IsSupported())
+    {
+        names.push_back("x64");
+    }
+
+    return names;
+}
+
+std::unique_ptr<CompilerBackend> CreateBackend(StringRef name)
+{
+    if (name == "mir")
+    {
+        return std::make_unique<MirCompiler>();
+    }
+
+    if (name == "tiered")
+    {
+        // Promotes loops almost at once, so that the programs run optimized code as well.
+        return std::make_unique<MirCompiler>(MirCompilerOptions{.Tiered = true, .TierUpThreshold = 4});
+    }
+
+    if (name == "interp")
+    {
+        return std::make_unique<Interpreter>();
+    }
+
+    if (name == "x64")
+    {
+        return std::make_unique<X64Compiler>();
+    }
+
+    throw Exception::Formatted("unknown backend {}", name);
+}
+
+Outcome Run(const TestCase &test, const Configuration &configuration)
+{
+    const auto instructions = LexInstructions(test.Source);
+    SequenceInstructionReader reader(instructions.data(), instructions.data() + instructions.size());
+    const auto backend = CreateBackend(configuration.Backend);
+    const CompiledProgram program(*backend, CompilerContext{
+                                                .Reader = &reader,
+                                                .GuardSize = configuration.GuardSize,
+                                                .CellBits = configuration.CellBits,
+                                                .PrefixSteps = configuration.PrefixSteps,
+                                            });
+
+    Tape tape(TapeOptions{.Size = test.HeapSize, .GuardSize = configuration.GuardSize});
+    auto input = Vector<CharType>(test.Input.begin(), test.Input.end());
+    MemoryOutputBuffer output;
+    auto inputBuffer = InputBuffer{
+        .Cursor = input.data(),
+        .Limit = input.data() + input.size(),
+        .Refill = [](InputBuffer *) { return Result::ReadError; },
+    };
+    const auto status = program.Run(tape, output, inputBuffer);
+
+    return Outcome{.Status = status, .Output = output.Contents()};
+}
+
+String Describe(const Outcome &outcome)
+{
+    String output;
+    for (const auto character : outcome.Output)
+    {
+        const auto byte = static_cast<unsigned char>(character);
+        output += byte >= 0x20 && byte < 0x7f ? fmt::format("{}", character) : fmt::format("\\x{:02x}", byte);
+    }
+
+    return fmt::format("{} \"{}\"", ResultName(outcome.Status), output);
+}
+
+String Describe(const Configuration &configuration)
+{
+    return fmt::format("{}, {}-bit cells, guard {}, prefix {}", configuration.Backend, configuration.CellBits,
+                       configuration.GuardSize, configuration.PrefixSteps);
+}
+
+// Every configuration has to produce the expected output and result, with and without guard regions and prefix
+// evaluation.
+std::size_t RunTestCase(const TestCase &test, const Vector<String> &backends)
+{
+    std::size_t failures = 0;
+    const auto fail = [&](const Configuration &configuration, StringRef reason) {
+        fmt::print("FAIL {} ({}): {}\n", test.Name, Describe(configuration), reason);
+        ++failures;
+    };
+
+    const auto expected = Outcome{.Status = test.ExpectedStatus, .Output = test.ExpectedOutput};
+    for (const auto cellBits : test.CellBits)
+    {
+        for (const auto &backend : backends)
+        {
+            for (const UInt32 guardSize : {0, 1 << 16})
+            {
+                if (guardSize && test.HeapSize % 4096)
+                {
+                    continue;
+                }
+
+                for (const UInt64 prefixSteps : {0, 1 << 20})
+                {
+                    const auto configuration = Configuration{
+                        .Backend = backend,
+                        .CellBits = cellBits,
+                        .GuardSize = guardSize,
+                        .PrefixSteps = prefixSteps,
+                    };
+                    try
+                    {
+                        const auto outcome = Run(test, configuration);
+                        if (outcome != expected)
+                        {
+                            fail(configuration,
+                                 fmt::format("expected {}, got {}", Describe(expected), Describe(outcome)));
+                        }
+                    }
+                    catch (Exception &ex)
+                    {
+                        fail(configuration, ex.reason());
+                    }
+                }
+            }
+        }
+    }
+
+    fmt::print("{} {}\n", failures ? "FAIL" : "ok  ", test.Name);
+    return failures;
+}
+
+// Runs a program prompting for its input over pipes, which only gets the answer once the prompt has come out. The
+// answer is given anyway after a while, so that the program finishes either way.
+Outcome RunPrompt(StringRef backendName)
+{
+    const auto backend = CreateBackend(backendName);
+    const CompiledProgram program(*backend, "+++.,.");
+
+    Pipe inputPipe;
+    Pipe outputPipe;
+    FileOutputBuffer output(outputPipe.WriteEnd());
+    FileInputBuffer input(inputPipe.ReadEnd(), &output);
+    Tape tape(TapeOptions{.Size = 4096});
+    auto status = Result::Success;
+    std::thread runner([&] { status = program.Run(tape, output, input); });
+
+    auto prompt = pollfd{.fd = outputPipe.ReadEnd(), .events = POLLIN};
+    const auto isPrompted = poll(&prompt, 1, 5000) == 1;
+    const auto answer = CharType{'?'};
+    const auto written = write(inputPipe.WriteEnd(), &answer, 1);
+    runner.join();
+    if (written != 1)
+    {
+        throw Exception::Formatted("failed to write the answer: {}", std::strerror(errno));
+    }
+    if (!isPrompted)
+    {
+        return Outcome{.Status = status};
+    }
+
+    output.FlushAll();
+    outputPipe.CloseWriteEnd();
+    String contents;
+    std::array<CharType, 16> chunk = {};
+    for (ssize_t count; (count = read(outputPipe.ReadEnd(), chunk.data(), chunk.size())) > 0;)
+    {
+        contents.append(chunk.data(), static_cast<std::size_t>(count));
+    }
+
+    return Outcome{.Status = status, .Output = contents};
+}
+
+std::size_t RunPromptTestCase(const Vector<String> &backends)
+{
+    std::size_t failures = 0;
+    const auto expected = Outcome{.Output = "\x03?"};
+    for (const auto &backend : backends)
+    {
+        try
+        {
+            const auto outcome = RunPrompt(backend);
+            if (outcome != expected)
+            {
+                fmt::print("FAIL prompt ({}): expected {}, got {}\n", backend, Describe(expected), Describe(outcome));
+                ++failures;
+            }
+        }
+        catch (Exception &ex)
+        {
+            fmt::print("FAIL prompt ({}): {}\n", backend, ex.reason());
+            ++failures;
+        }
+    }
+
+    fmt::print("{} prompt\n", failures ? "FAIL" : "ok  ");
+    return failures;
+}
+} // namespace
+
+int main(int argc, const char **argv)
+{
+    try
+    {
+        auto cases = LoadCorpus(argc > 1 ? argv[1] : BFJIT_TEST_CORPUS);
+        for (auto &test : EdgeCases())
+        {
+            cases.push_back(std::move(test));
+        }
+
+        const auto backends = CreateBackendNames();
+        std::size_t failedCases = 0;
+        for (const auto &test : cases)
+        {
+            failedCases += RunTestCase(test, backends) != 0;
+        }
+
+        failedCases += RunPromptTestCase(backends) != 0;
+
+        const auto caseCount = cases.size() + 1;
+        fmt::print("{} of {} cases passed\n", caseCount - failedCases, caseCount);
+        return failedCases ? 1 : 0;
+    }
+    catch (Exception &ex)
+    {
+        fmt::print("failed to run tests: {}\n", ex.reason());
+    }
+    catch (std::filesystem::filesystem_error &ex)
+    {
+        fmt::print("failed to load corpus: {}\n", ex.what());
+    }
+
+    return 1;
+}
@@ -0,0 +1,93 @@
+#include "thread_pool.hpp"
+
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace bfjit;
+
+namespace
+{
+struct TaskQueue
+{
+    std::mutex Mutex;
+    std::deque<std::size_t> Tasks;
+
+    Optional<std::size_t> PopBack()
+    {
+        const std::lock_guard lock(Mutex);
+        if (Tasks.empty())
+        {
+            return std::nullopt;
+        }
+
+        const auto task = Tasks.back();
+        Tasks.pop_back();
+        return task;
+    }
+
+    Optional<std::size_t> PopFront()
+    {
+        const std::lock_guard lock(Mutex);
+        if (Tasks.empty())
+        {
+            return std::nullopt;
+        }
+
+        const auto task = Tasks.front();
+        Tasks.pop_front();
+        return task;
+    }
+};
+
+// No tasks are added once the workers start, so a worker finding every queue empty is done.
+Optional<std::size_t> NextTask(Vector<TaskQueue> &queues, UInt32 worker)
+{
+    if (const auto task = queues[worker].PopBack())
+    {
+        return task;
+    }
+
+    for (UInt32 offset = 1; offset < queues.size(); ++offset)
+    {
+        if (const auto task = queues[(worker + offset) % queues.size()].PopFront())
+        {
+            return task;
+        }
+    }
+
+    return std::nullopt;
+}
+} // namespace
+
+void bfjit::RunWorkStealing(std::size_t taskCount, UInt32 workerCount,
+                            const std::function<void(UInt32 worker, std::size_t task)> &run)
+{
+    assert(workerCount);
+    assert(run);
+
+    // Tasks are dealt in reverse, so that every worker starts with the lowest of its tasks.
+    Vector<TaskQueue> queues(workerCount);
+    for (auto task = taskCount; task-- > 0;)
+    {
+        queues[task % workerCount].Tasks.push_back(task);
+    }
+
+    Vector<std::thread> threads;
+    threads.reserve(workerCount);
+    for (UInt32 worker = 0; worker < workerCount; ++worker)
+    {
+        threads.emplace_back([&, worker] {
+            while (const auto task = NextTask(queues, worker))
+            {
+                run(worker, *task);
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef BFJIT_THREAD_POOL_HPP
+#define BFJIT_THREAD_POOL_HPP
+
+#include "types.hpp"
+
+#include <functional>
+
+namespace bfjit
+{
+// Runs the tasks `0` to `taskCount - 1` on `workerCount` threads and waits for all of them to finish. Tasks are dealt
+// out to the workers up front; a worker runs its own tasks from the back of its queue and, once the queue is empty,
+// steals tasks from the front of the others, so that a few long tasks don't leave the rest of the workers idle. `run`
+// gets the index of the worker running the task, which lets callers keep per-worker state, and must not throw.
+void RunWorkStealing(std::size_t taskCount, UInt32 workerCount,
+                     const std::function<void(UInt32 worker, std::size_t task)> &run);
+} // namespace bfjit
+
+#endif // BFJIT_THREAD_POOL_HPP
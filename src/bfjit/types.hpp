@@ -3,7 +3,9 @@
 
 #include "instruction.hpp"
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -16,6 +18,8 @@ using CharPtr = CharType *;
 using String = std::string;
 using StringRef = std::string_view;
 using UInt32 = std::uint32_t;
+using UInt64 = std::uint64_t;
+using Int64 = std::int64_t;
 using Boolean = bool;
 
 template<typename T> using Optional = std::optional<T>;
@@ -30,21 +34,76 @@ enum class Result : UInt32
     OutOfMemory,
 };
 
-using WriteCharFunc = Result (*)(CharType);
-using ReadCharFunc = Result (*)(CharPtr);
-using MainFunc = Result (*)(CharPtr, CharPtr);
+inline StringRef ResultName(Result result) noexcept
+{
+    switch (result)
+    {
+    case Result::Success:
+        return "success";
+    case Result::WriteError:
+        return "write error";
+    case Result::ReadError:
+        return "read error";
+    case Result::MemoryUnderrun:
+        return "memory underrun";
+    case Result::OutOfMemory:
+        return "out of memory";
+    }
+
+    return "unknown";
+}
+
+struct OutputBuffer;
+struct InputBuffer;
+
+using FlushOutputFunc = Result (*)(OutputBuffer *);
+using RefillInputFunc = Result (*)(InputBuffer *);
+
+// Generated code appends characters at `Cursor` and only calls `Flush` once it reaches `Limit`; a successful flush
+// must make room for at least one more character.
+struct OutputBuffer
+{
+    CharPtr Cursor;
+    CharPtr Limit;
+    FlushOutputFunc Flush;
+};
+
+// Generated code reads characters at `Cursor` and only calls `Refill` once it reaches `Limit`; a successful refill
+// must make at least one more character available.
+struct InputBuffer
+{
+    CharPtr Cursor;
+    CharPtr Limit;
+    RefillInputFunc Refill;
+};
+
+using MainFunc = Result (*)(CharPtr, CharPtr, OutputBuffer *, InputBuffer *);
+
+// A compiled program callable like `MainFunc`, which may carry state the backend needs to run it.
+using Entrypoint = std::function<Result(CharPtr, CharPtr, OutputBuffer *, InputBuffer *)>;
+
+struct CompilerStatistics;
+struct LoopProfile;
 
+// Pointer moves reaching at most `GuardSize` bytes past the tape bounds are left unchecked, the tape being expected
+// to fault on accesses there. `Statistics`, when set, receives the time spent in every compilation phase, and
+// `Profile` the counters of the loops the compiled program runs. Cells are `CellBits` wide, and the compiled program
+// expects the tape it's given to hold a whole number of them. Up to `PrefixSteps` operations preceding the first
+// input are run at compile time, the compiled program starting out with their results; zero disables that.
 struct CompilerContext
 {
-    WriteCharFunc WriteChar;
-    ReadCharFunc ReadChar;
     InstructionReader *Reader;
+    UInt32 GuardSize = 0;
+    UInt32 CellBits = 8;
+    UInt64 PrefixSteps = 0;
+    CompilerStatistics *Statistics = nullptr;
+    LoopProfile *Profile = nullptr;
 };
 
 struct CompilerBackend
 {
     virtual ~CompilerBackend() = default;
-    virtual MainFunc Compile(const CompilerContext &context) = 0;
+    virtual Entrypoint Compile(const CompilerContext &context) = 0;
 };
 } // namespace bfjit
 
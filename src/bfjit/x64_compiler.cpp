@@ -0,0 +1,1130 @@
+#include "x64_compiler.hpp"
+#include "cell.hpp"
+#include "exception.hpp"
+#include "io.hpp"
+#include "ir.hpp"
+#include "prefix.hpp"
+#include "profile.hpp"
+#include "scan.hpp"
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#include <elf.h>
+#include <sys/mman.h>
+
+using namespace bfjit;
+
+namespace
+{
+enum class Register : UInt32
+{
+    Rax,
+    Rcx,
+    Rdx,
+    Rbx,
+    Rsp,
+    Rbp,
+    Rsi,
+    Rdi,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+// The low nibble of the `Jcc` opcodes.
+enum class Condition : std::uint8_t
+{
+    Below = 0x2,
+    AboveOrEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    BelowOrEqual = 0x6,
+};
+
+// The extension of the group 1 arithmetic opcodes held by the reg field of their ModRM byte.
+enum class Arithmetic : UInt32
+{
+    Add = 0,
+    Compare = 7,
+};
+
+using Label = std::size_t;
+
+Boolean FitsInt8(Int64 value) noexcept
+{
+    return value >= std::numeric_limits<std::int8_t>::min() && value <= std::numeric_limits<std::int8_t>::max();
+}
+
+Boolean FitsInt32(Int64 value) noexcept
+{
+    return value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max();
+}
+
+// Encodes the handful of instructions the generator needs. Memory operands are always a base register plus a
+// displacement, and the base is never `rsp` or `r12`, which would require a SIB byte. Jumps always take 32-bit
+// displacements, which are patched once the code is complete.
+class Assembler
+{
+public:
+    Label NewLabel()
+    {
+        m_labels.push_back(Unbound);
+        return m_labels.size() - 1;
+    }
+
+    void Bind(Label label)
+    {
+        assert(m_labels[label] == Unbound);
+
+        m_labels[label] = m_code.size();
+    }
+
+    Vector<std::uint8_t> Finish()
+    {
+        for (const auto &[position, label] : m_fixups)
+        {
+            assert(m_labels[label] != Unbound);
+
+            const auto distance = static_cast<Int64>(m_labels[label]) - static_cast<Int64>(position + 4);
+            if (!FitsInt32(distance))
+            {
+                throw Exception("the generated code is too large to jump across");
+            }
+            const auto value = static_cast<std::int32_t>(distance);
+            std::memcpy(m_code.data() + position, &value, sizeof(value));
+        }
+
+        return std::move(m_code);
+    }
+
+    const Vector<CodeRelocation> &Relocations() const noexcept
+    {
+        return m_relocations;
+    }
+
+    void Push(Register reg)
+    {
+        Prefix(4, Register::Rax, reg);
+        Byte(0x50 + Low(reg));
+    }
+
+    void Pop(Register reg)
+    {
+        Prefix(4, Register::Rax, reg);
+        Byte(0x58 + Low(reg));
+    }
+
+    void Return()
+    {
+        Byte(0xC3);
+    }
+
+    void Move(Register target, Register source)
+    {
+        Prefix(8, source, target);
+        Byte(0x89);
+        Direct(source, target);
+    }
+
+    // Picks the shortest encoding: 32-bit moves clear the upper half of the register, and 64-bit ones sign-extend
+    // their 32-bit immediate.
+    void MoveImmediate(Register target, Int64 value)
+    {
+        if (value >= 0 && value <= std::numeric_limits<std::uint32_t>::max())
+        {
+            Prefix(4, Register::Rax, target);
+            Byte(0xB8 + Low(target));
+            Int32(static_cast<std::uint32_t>(value));
+        }
+        else if (FitsInt32(value))
+        {
+            Prefix(8, Register::Rax, target);
+            Byte(0xC7);
+            Direct(Register::Rax, target);
+            Int32(static_cast<std::uint32_t>(value));
+        }
+        else
+        {
+            Prefix(8, Register::Rax, target);
+            Byte(0xB8 + Low(target));
+            Int32(static_cast<std::uint32_t>(value));
+            Int32(static_cast<std::uint32_t>(static_cast<UInt64>(value) >> 32));
+        }
+    }
+
+    // Zero-extends `width` bytes at the address into the whole register.
+    void Load(UInt32 width, Register target, Register base, std::int32_t displacement)
+    {
+        Prefix(width == 8 ? 8 : 4, target, base);
+        switch (width)
+        {
+        case 1:
+            Byte(0x0F);
+            Byte(0xB6);
+            break;
+        case 2:
+            Byte(0x0F);
+            Byte(0xB7);
+            break;
+        default:
+            Byte(0x8B);
+            break;
+        }
+        Memory(target, base, displacement);
+    }
+
+    // Only `rax`, `rcx`, `rdx` and `rbx` are stored as bytes, as the others would need an empty REX prefix.
+    void Store(UInt32 width, Register base, std::int32_t displacement, Register source)
+    {
+        assert(width != 1 || static_cast<UInt32>(source) < 4);
+
+        Prefix(width, source, base);
+        Byte(width == 1 ? 0x88 : 0x89);
+        Memory(source, base, displacement);
+    }
+
+    void StoreImmediate(UInt32 width, Register base, std::int32_t displacement, Int64 value)
+    {
+        Prefix(width, Register::Rax, base);
+        Byte(width == 1 ? 0xC6 : 0xC7);
+        Memory(Register::Rax, base, displacement);
+        Immediate(width, value);
+    }
+
+    void AddToMemory(UInt32 width, Register base, std::int32_t displacement, Register source)
+    {
+        assert(width != 1 || static_cast<UInt32>(source) < 4);
+
+        Prefix(width, source, base);
+        Byte(width == 1 ? 0x00 : 0x01);
+        Memory(source, base, displacement);
+    }
+
+    void ArithmeticWithMemory(Arithmetic operation, UInt32 width, Register base, std::int32_t displacement,
+                              Int64 value)
+    {
+        const auto extension = static_cast<Register>(operation);
+        Prefix(width, Register::Rax, base);
+        if (width == 1)
+        {
+            Byte(0x80);
+            Memory(extension, base, displacement);
+            Immediate(1, value);
+        }
+        else if (FitsInt8(value))
+        {
+            Byte(0x83);
+            Memory(extension, base, displacement);
+            Immediate(1, value);
+        }
+        else
+        {
+            Byte(0x81);
+            Memory(extension, base, displacement);
+            Immediate(width, value);
+        }
+    }
+
+    void ArithmeticWithImmediate(Arithmetic operation, Register target, std::int32_t value)
+    {
+        const auto extension = static_cast<Register>(operation);
+        Prefix(8, extension, target);
+        Byte(FitsInt8(value) ? 0x83 : 0x81);
+        Direct(extension, target);
+        Immediate(FitsInt8(value) ? 1 : 4, value);
+    }
+
+    void Add(Register target, Register source)
+    {
+        Prefix(8, source, target);
+        Byte(0x01);
+        Direct(source, target);
+    }
+
+    void Subtract(Register target, Register source)
+    {
+        Prefix(8, source, target);
+        Byte(0x29);
+        Direct(source, target);
+    }
+
+    void Compare(Register left, Register right)
+    {
+        Prefix(8, right, left);
+        Byte(0x39);
+        Direct(right, left);
+    }
+
+    void CompareWithMemory(Register left, Register base, std::int32_t displacement)
+    {
+        Prefix(8, left, base);
+        Byte(0x3B);
+        Memory(left, base, displacement);
+    }
+
+    void Test(Register left, Register right)
+    {
+        Prefix(8, right, left);
+        Byte(0x85);
+        Direct(right, left);
+    }
+
+    void TestResult()
+    {
+        Prefix(4, Register::Rax, Register::Rax);
+        Byte(0x85);
+        Direct(Register::Rax, Register::Rax);
+    }
+
+    void Multiply(Register target, Register source)
+    {
+        Prefix(8, target, source);
+        Byte(0x0F);
+        Byte(0xAF);
+        Direct(target, source);
+    }
+
+    void MultiplyImmediate(Register target, Register source, std::int32_t value)
+    {
+        Prefix(8, target, source);
+        Byte(0x69);
+        Direct(target, source);
+        Int32(static_cast<std::uint32_t>(value));
+    }
+
+    void IncrementMemory(Register base)
+    {
+        Prefix(8, Register::Rax, base);
+        Byte(0xFF);
+        Memory(Register::Rax, base, 0);
+    }
+
+    void Call(Register target)
+    {
+        Prefix(4, Register::Rax, target);
+        Byte(0xFF);
+        Direct(Register::Rdx, target);
+    }
+
+    void CallMemory(Register base, std::int32_t displacement)
+    {
+        Prefix(4, Register::Rax, base);
+        Byte(0xFF);
+        Memory(Register::Rdx, base, displacement);
+    }
+
+    // Left for the linker to point at `symbol`, which it keeps within reach of the relative call.
+    void CallSymbol(const String &symbol)
+    {
+        Byte(0xE8);
+        Relocate(R_X86_64_PLT32, symbol, 0);
+    }
+
+    // Loads the address `offset` bytes into the data of relocatable code.
+    void LoadDataAddress(Register target, Int64 offset)
+    {
+        Prefix(8, target, Register::Rax);
+        Byte(0x8D);
+        Byte(Low(target) << 3 | Low(Register::Rbp));
+        Relocate(R_X86_64_PC32, String(), offset);
+    }
+
+    void Jump(Label label)
+    {
+        Byte(0xE9);
+        Fixup(label);
+    }
+
+    void JumpIf(Condition condition, Label label)
+    {
+        Byte(0x0F);
+        Byte(0x80 | static_cast<std::uint8_t>(condition));
+        Fixup(label);
+    }
+
+private:
+    static constexpr std::size_t Unbound = std::numeric_limits<std::size_t>::max();
+
+    static UInt32 Low(Register reg) noexcept
+    {
+        return static_cast<UInt32>(reg) & 7;
+    }
+
+    static UInt32 High(Register reg) noexcept
+    {
+        return static_cast<UInt32>(reg) >> 3;
+    }
+
+    void Byte(UInt32 value)
+    {
+        m_code.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    void Int32(std::uint32_t value)
+    {
+        for (UInt32 index = 0; index < 4; ++index)
+        {
+            Byte(value >> (8 * index) & 0xFF);
+        }
+    }
+
+    // Immediates are truncated to the operand width, which the instructions sign-extend where they're narrower.
+    void Immediate(UInt32 width, Int64 value)
+    {
+        const auto bits = static_cast<UInt64>(value);
+        for (UInt32 index = 0; index < std::min(width, 4u); ++index)
+        {
+            Byte(bits >> (8 * index) & 0xFF);
+        }
+    }
+
+    // The operand size prefix selects 16-bit operands, and REX.W 64-bit ones.
+    void Prefix(UInt32 width, Register reg, Register base)
+    {
+        if (width == 2)
+        {
+            Byte(0x66);
+        }
+
+        const auto rex = (width == 8 ? 0x08 : 0) | High(reg) << 2 | High(base);
+        if (rex)
+        {
+            Byte(0x40 | rex);
+        }
+    }
+
+    void Direct(Register reg, Register target)
+    {
+        Byte(0xC0 | Low(reg) << 3 | Low(target));
+    }
+
+    // A zero displacement from `rbp` or `r13` would encode a RIP-relative address instead, so it takes a byte.
+    void Memory(Register reg, Register base, std::int32_t displacement)
+    {
+        assert(Low(base) != Low(Register::Rsp));
+
+        if (displacement == 0 && Low(base) != Low(Register::Rbp))
+        {
+            Byte(Low(reg) << 3 | Low(base));
+        }
+        else if (FitsInt8(displacement))
+        {
+            Byte(0x40 | Low(reg) << 3 | Low(base));
+            Byte(static_cast<std::uint8_t>(displacement));
+        }
+        else
+        {
+            Byte(0x80 | Low(reg) << 3 | Low(base));
+            Int32(static_cast<std::uint32_t>(displacement));
+        }
+    }
+
+    void Fixup(Label label)
+    {
+        m_fixups.emplace_back(m_code.size(), label);
+        Int32(0);
+    }
+
+    // Relative displacements are taken from the end of the instruction, which the 32-bit field ends here.
+    void Relocate(UInt32 type, const String &symbol, Int64 offset)
+    {
+        m_relocations.push_back(
+            CodeRelocation{.Offset = m_code.size(), .Type = type, .Symbol = symbol, .Addend = offset - 4});
+        Int32(0);
+    }
+
+    Vector<std::uint8_t> m_code;
+    Vector<std::size_t> m_labels;
+    Vector<std::pair<std::size_t, Label>> m_fixups;
+    Vector<CodeRelocation> m_relocations;
+};
+
+// The state of the program lives in callee-saved registers, so that it survives calls into the runtime, and the
+// arguments are moved there on entry.
+constexpr inline auto CurrentPtrRegister = Register::Rbx;
+constexpr inline auto BeginRegister = Register::R12;
+constexpr inline auto EndRegister = Register::R13;
+constexpr inline auto OutputRegister = Register::R14;
+constexpr inline auto InputRegister = Register::R15;
+constexpr inline Register SavedRegisters[] = {
+    CurrentPtrRegister, BeginRegister, EndRegister, OutputRegister, InputRegister,
+};
+
+// Follows the same rules as the other backends when deciding which accesses to check, `rax`, `rcx` and `rdx` being
+// the only registers it uses besides the saved ones and the call arguments.
+template <typename Cell> struct CodeGenerator
+{
+    using Value = typename Cell::Value;
+
+    static constexpr auto Width = static_cast<UInt32>(Cell::Bytes);
+
+    UInt32 GuardSize = 0;
+    LoopProfile *Profile = nullptr;
+    // Runtime functions and blocks are referred to through relocations rather than their addresses, the blocks being
+    // copied to `Data`.
+    Boolean Relocatable = false;
+    Vector<CharType> Data;
+    std::size_t NextProfiledLoop = 0;
+    // The cells from `KnownMinOffset` to `KnownMaxOffset` relative to the current one are on the tape, as something
+    // would have failed on the way here otherwise.
+    Int64 KnownMinOffset = 0;
+    Int64 KnownMaxOffset = 0;
+    Assembler Code;
+    Label ReturnLabel = 0;
+    Label OutOfMemoryErrorLabel = 0;
+    Label MemoryUnderrunErrorLabel = 0;
+
+    // The five pushes leave the stack aligned for calls, the return address having misaligned it by eight bytes.
+    Vector<std::uint8_t> Compile(const ir::Program &program)
+    {
+        ReturnLabel = Code.NewLabel();
+        OutOfMemoryErrorLabel = Code.NewLabel();
+        MemoryUnderrunErrorLabel = Code.NewLabel();
+
+        for (const auto reg : SavedRegisters)
+        {
+            Code.Push(reg);
+        }
+        Code.Move(CurrentPtrRegister, Register::Rdi);
+        Code.Move(BeginRegister, Register::Rdi);
+        Code.Move(EndRegister, Register::Rsi);
+        Code.Move(OutputRegister, Register::Rdx);
+        Code.Move(InputRegister, Register::Rcx);
+
+        EmitOperations(program);
+
+        if (GuardSize)
+        {
+            // The last move may have left the tape without touching a cell.
+            Code.Compare(CurrentPtrRegister, EndRegister);
+            Code.JumpIf(Condition::AboveOrEqual, OutOfMemoryErrorLabel);
+            Code.Compare(CurrentPtrRegister, BeginRegister);
+            Code.JumpIf(Condition::Below, MemoryUnderrunErrorLabel);
+        }
+        Code.MoveImmediate(Register::Rax, static_cast<Int64>(Result::Success));
+
+        // Runtime calls jump here with their result already in `eax`.
+        Code.Bind(ReturnLabel);
+        for (auto reg = std::rbegin(SavedRegisters); reg != std::rend(SavedRegisters); ++reg)
+        {
+            Code.Pop(*reg);
+        }
+        Code.Return();
+
+        Code.Bind(OutOfMemoryErrorLabel);
+        Code.MoveImmediate(Register::Rax, static_cast<Int64>(Result::OutOfMemory));
+        Code.Jump(ReturnLabel);
+        Code.Bind(MemoryUnderrunErrorLabel);
+        Code.MoveImmediate(Register::Rax, static_cast<Int64>(Result::MemoryUnderrun));
+        Code.Jump(ReturnLabel);
+
+        return Code.Finish();
+    }
+
+    void EmitOperations(const ir::Program &operations)
+    {
+        for (const auto &operation : operations)
+        {
+            switch (operation.Kind)
+            {
+            case ir::OperationKind::AddCell:
+                EmitAddCellOperation(operation.Value, operation.Offset);
+                break;
+            case ir::OperationKind::SetCell:
+                EmitAccessCheck(operation.Offset, operation.Offset);
+                EmitStoreCell(operation.Value, operation.Offset);
+                break;
+            case ir::OperationKind::MovePtr:
+                EmitMovePtrOperation(operation.Value);
+                break;
+            case ir::OperationKind::Loop:
+                EmitLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyLoop:
+                EmitLoopEntryCount(operation);
+                EmitMultiplyLoopOperation(operation);
+                break;
+            case ir::OperationKind::MultiplyAdd:
+                assert(false);
+                break;
+            case ir::OperationKind::ScanLoop:
+                EmitLoopEntryCount(operation);
+                EmitScanLoopOperation(operation.Value);
+                break;
+            case ir::OperationKind::WriteChar:
+                EmitWriteCharOperation(operation.Offset);
+                break;
+            case ir::OperationKind::ReadChar:
+                EmitReadCharOperation(operation.Offset);
+                break;
+            case ir::OperationKind::StoreBlock:
+                EmitStoreBlockOperation(operation);
+                break;
+            case ir::OperationKind::WriteBlock:
+                EmitWriteBlockOperation(operation);
+                break;
+            }
+        }
+    }
+
+    void EmitAddCellOperation(Int64 value, Int64 offset)
+    {
+        EmitAccessCheck(offset, offset);
+
+        const auto operand = Truncate(value);
+        if (FitsInt32(operand))
+        {
+            Code.ArithmeticWithMemory(Arithmetic::Add, Width, CurrentPtrRegister, Displacement(offset), operand);
+            return;
+        }
+
+        Code.MoveImmediate(Register::Rax, operand);
+        Code.AddToMemory(Width, CurrentPtrRegister, Displacement(offset), Register::Rax);
+    }
+
+    void EmitStoreCell(Int64 value, Int64 offset)
+    {
+        const auto operand = Truncate(value);
+        if (FitsInt32(operand))
+        {
+            Code.StoreImmediate(Width, CurrentPtrRegister, Displacement(offset), operand);
+            return;
+        }
+
+        Code.MoveImmediate(Register::Rax, operand);
+        Code.Store(Width, CurrentPtrRegister, Displacement(offset), Register::Rax);
+    }
+
+    void EmitMovePtrOperation(Int64 distance)
+    {
+        EmitAccessCheck(distance, distance);
+
+        const auto bytes = distance * Cell::Bytes;
+        if (FitsInt32(bytes))
+        {
+            Code.ArithmeticWithImmediate(Arithmetic::Add, CurrentPtrRegister, static_cast<std::int32_t>(bytes));
+        }
+        else
+        {
+            Code.MoveImmediate(Register::Rax, bytes);
+            Code.Add(CurrentPtrRegister, Register::Rax);
+        }
+
+        // The cells known to be on the tape stay there, including the one the pointer has moved to if it was checked.
+        KnownMinOffset -= distance;
+        KnownMaxOffset -= distance;
+    }
+
+    // Balanced loops start every iteration where they were entered, so the cells all of their iterations access are
+    // checked once before the first one. Other loops have them checked at the start of every iteration.
+    void EmitLoopOperation(const ir::Operation &loop)
+    {
+        const auto counters = EmitLoopEntryCount(loop);
+        const auto openLabel = Code.NewLabel();
+        const auto closeLabel = Code.NewLabel();
+
+        EmitTestCell();
+        Code.JumpIf(Condition::Equal, closeLabel);
+
+        const auto range = ir::AnalyzeLoopRange(loop);
+        const auto knownMinOffset = KnownMinOffset;
+        const auto knownMaxOffset = KnownMaxOffset;
+        if (range.IsBalanced)
+        {
+            EmitAccessCheck(range.MinOffset, range.MaxOffset);
+        }
+        else
+        {
+            ForgetRange();
+        }
+
+        Code.Bind(openLabel);
+        if (counters)
+        {
+            EmitCount(&counters->Iterations);
+        }
+
+        if (!range.IsBalanced)
+        {
+            EmitAccessCheck(range.MinOffset, range.MaxOffset);
+        }
+        EmitOperations(loop.Body);
+
+        EmitTestCell();
+        Code.JumpIf(Condition::NotEqual, openLabel);
+        Code.Bind(closeLabel);
+
+        if (range.IsBalanced)
+        {
+            KnownMinOffset = knownMinOffset;
+            KnownMaxOffset = knownMaxOffset;
+        }
+        else
+        {
+            ForgetRange();
+        }
+    }
+
+    // Loops are instrumented in the order they appear in, matching the counters listed by `LoopProfile::Reset`.
+    LoopCounters *EmitLoopEntryCount(const ir::Operation &loop)
+    {
+        if (!Profile)
+        {
+            return nullptr;
+        }
+
+        assert(NextProfiledLoop < Profile->Loops.size());
+        auto &counters = Profile->Loops[NextProfiledLoop++];
+        assert(counters.Kind == loop.Kind && counters.Position == loop.Position);
+
+        EmitCount(&counters.Entries);
+        return &counters;
+    }
+
+    void EmitCount(UInt64 *counter)
+    {
+        Code.MoveImmediate(Register::Rax, reinterpret_cast<Int64>(counter));
+        Code.IncrementMemory(Register::Rax);
+    }
+
+    // The counter stays in `rax` while the products are added to their targets.
+    void EmitMultiplyLoopOperation(const ir::Operation &loop)
+    {
+        const auto &body = loop.Body;
+        assert(!body.empty());
+
+        const auto skipLabel = Code.NewLabel();
+        Code.Load(Width, Register::Rax, CurrentPtrRegister, 0);
+        Code.Test(Register::Rax, Register::Rax);
+        Code.JumpIf(Condition::Equal, skipLabel);
+
+        // Targets are sorted by offset, and the loop would have visited every one of them. The check only runs when the
+        // loop does, so it isn't remembered. Within the guard regions the outermost target faults by itself, as long as
+        // the loop has targets on one side only and adds something to it. Otherwise the range is checked, and since the
+        // end of a range is checked before its start, the start is checked on its own first when the loop would have
+        // run off it first.
+        const auto minOffset = body.front().Offset;
+        const auto maxOffset = body.back().Offset;
+        const auto isTwoSided = minOffset < 0 && maxOffset > 0;
+        const auto &outermost = maxOffset > 0 ? body.back() : body.front();
+        const auto isFaulting = !isTwoSided && Truncate(outermost.Value) != 0;
+        if (!IsKnown(minOffset, maxOffset) && (IsChecked(minOffset, maxOffset) || !isFaulting))
+        {
+            if (isTwoSided && loop.Value == minOffset)
+            {
+                EmitRangeCheck(minOffset, minOffset);
+            }
+            EmitRangeCheck(minOffset, maxOffset);
+        }
+
+        for (const auto &operation : body)
+        {
+            assert(operation.Kind == ir::OperationKind::MultiplyAdd);
+
+            const auto factor = Truncate(operation.Value);
+            if (factor == 0)
+            {
+                continue;
+            }
+
+            if (FitsInt32(factor))
+            {
+                Code.MultiplyImmediate(Register::Rdx, Register::Rax, static_cast<std::int32_t>(factor));
+            }
+            else
+            {
+                Code.MoveImmediate(Register::Rdx, factor);
+                Code.Multiply(Register::Rdx, Register::Rax);
+            }
+            Code.AddToMemory(Width, CurrentPtrRegister, Displacement(operation.Offset), Register::Rdx);
+        }
+
+        EmitStoreCell(0, 0);
+        Code.Bind(skipLabel);
+    }
+
+    // Testing the first cell here skips the call for loops that don't run, and makes the access that lands in a guard
+    // region fault in the generated code rather than in the kernel.
+    void EmitScanLoopOperation(Int64 stride)
+    {
+        assert(stride != 0);
+
+        const auto skipLabel = Code.NewLabel();
+        EmitTestCell();
+        Code.JumpIf(Condition::Equal, skipLabel);
+
+        // The scan kernels count the stride in cells, and return null instead of walking off the tape.
+        Code.Move(Register::Rdi, CurrentPtrRegister);
+        Code.Move(Register::Rsi, stride > 0 ? EndRegister : BeginRegister);
+        Code.MoveImmediate(Register::Rdx, stride > 0 ? stride : -stride);
+        const auto scan = stride > 0 ? &ScanForward<Cell> : &ScanBackward<Cell>;
+        EmitCall(fmt::format("bfjit_scan_{}_{}", stride > 0 ? "forward" : "backward", Cell::Bits),
+                 reinterpret_cast<const void *>(scan));
+        Code.Test(Register::Rax, Register::Rax);
+        Code.JumpIf(Condition::Equal, stride > 0 ? OutOfMemoryErrorLabel : MemoryUnderrunErrorLabel);
+        Code.Move(CurrentPtrRegister, Register::Rax);
+
+        Code.Bind(skipLabel);
+        ForgetRange();
+    }
+
+    // The cell is read first, so that nothing is written out before an access to a guard region faults, and read
+    // again after a flush, which doesn't preserve `rax`. Wider cells are written out as their lowest byte.
+    void EmitWriteCharOperation(Int64 offset)
+    {
+        EmitAccessCheck(offset, offset);
+
+        const auto storeLabel = Code.NewLabel();
+        Code.Load(1, Register::Rax, CurrentPtrRegister, Displacement(offset));
+        Code.Load(8, Register::Rdx, OutputRegister, offsetof(OutputBuffer, Cursor));
+        Code.CompareWithMemory(Register::Rdx, OutputRegister, offsetof(OutputBuffer, Limit));
+        Code.JumpIf(Condition::NotEqual, storeLabel);
+
+        Code.Move(Register::Rdi, OutputRegister);
+        Code.CallMemory(OutputRegister, offsetof(OutputBuffer, Flush));
+        EmitReturnOnFailure();
+        Code.Load(8, Register::Rdx, OutputRegister, offsetof(OutputBuffer, Cursor));
+        Code.Load(1, Register::Rax, CurrentPtrRegister, Displacement(offset));
+
+        Code.Bind(storeLabel);
+        Code.Store(1, Register::Rdx, 0, Register::Rax);
+        Code.ArithmeticWithImmediate(Arithmetic::Add, Register::Rdx, 1);
+        Code.Store(8, OutputRegister, offsetof(OutputBuffer, Cursor), Register::Rdx);
+    }
+
+    void EmitReadCharOperation(Int64 offset)
+    {
+        EmitAccessCheck(offset, offset);
+
+        const auto loadLabel = Code.NewLabel();
+        Code.Load(8, Register::Rdx, InputRegister, offsetof(InputBuffer, Cursor));
+        Code.CompareWithMemory(Register::Rdx, InputRegister, offsetof(InputBuffer, Limit));
+        Code.JumpIf(Condition::NotEqual, loadLabel);
+
+        Code.Move(Register::Rdi, InputRegister);
+        Code.CallMemory(InputRegister, offsetof(InputBuffer, Refill));
+        EmitReturnOnFailure();
+        Code.Load(8, Register::Rdx, InputRegister, offsetof(InputBuffer, Cursor));
+
+        Code.Bind(loadLabel);
+        Code.Load(1, Register::Rax, Register::Rdx, 0);
+        Code.ArithmeticWithImmediate(Arithmetic::Add, Register::Rdx, 1);
+        Code.Store(8, InputRegister, offsetof(InputBuffer, Cursor), Register::Rdx);
+        Code.Store(Width, CurrentPtrRegister, Displacement(offset), Register::Rax);
+    }
+
+    // The block is referred to rather than copied, so the program has to outlive the code.
+    void EmitStoreBlockOperation(const ir::Operation &operation)
+    {
+        EmitBlockCheck(operation.Value);
+        if (operation.Data.empty())
+        {
+            return;
+        }
+
+        Code.Move(Register::Rdi, CurrentPtrRegister);
+        EmitLoadBlock(Register::Rsi, operation.Data);
+        Code.MoveImmediate(Register::Rdx, static_cast<Int64>(operation.Data.size()));
+        EmitCall("memcpy", reinterpret_cast<const void *>(&std::memcpy));
+    }
+
+    void EmitWriteBlockOperation(const ir::Operation &operation)
+    {
+        if (operation.Data.empty())
+        {
+            return;
+        }
+
+        Code.Move(Register::Rdi, OutputRegister);
+        EmitLoadBlock(Register::Rsi, operation.Data);
+        Code.MoveImmediate(Register::Rdx, static_cast<Int64>(operation.Data.size()));
+        EmitCall("bfjit_write_output", reinterpret_cast<const void *>(&WriteOutput));
+        EmitReturnOnFailure();
+    }
+
+    void EmitCall(const String &symbol, const void *function)
+    {
+        if (Relocatable)
+        {
+            Code.CallSymbol(symbol);
+            return;
+        }
+
+        Code.MoveImmediate(Register::Rax, reinterpret_cast<Int64>(function));
+        Code.Call(Register::Rax);
+    }
+
+    void EmitLoadBlock(Register target, const Vector<CharType> &block)
+    {
+        if (Relocatable)
+        {
+            Code.LoadDataAddress(target, static_cast<Int64>(Data.size()));
+            Data.insert(Data.end(), block.begin(), block.end());
+            return;
+        }
+
+        Code.MoveImmediate(target, reinterpret_cast<Int64>(block.data()));
+    }
+
+    void EmitTestCell()
+    {
+        Code.ArithmeticWithMemory(Arithmetic::Compare, Width, CurrentPtrRegister, 0, 0);
+    }
+
+    void EmitReturnOnFailure()
+    {
+        Code.TestResult();
+        Code.JumpIf(Condition::NotEqual, ReturnLabel);
+    }
+
+    Boolean IsKnown(Int64 minOffset, Int64 maxOffset) const noexcept
+    {
+        return minOffset >= KnownMinOffset && maxOffset <= KnownMaxOffset;
+    }
+
+    // The tape is contiguous, so every cell between the current one and a checked one is on it as well. Cells left to
+    // the guard regions aren't known to be on the tape until they're accessed, so they aren't remembered.
+    void EmitAccessCheck(Int64 minOffset, Int64 maxOffset)
+    {
+        if (IsKnown(minOffset, maxOffset) || !IsChecked(minOffset, maxOffset))
+        {
+            return;
+        }
+
+        EmitRangeCheck(minOffset, maxOffset);
+        KnownMinOffset = std::min(KnownMinOffset, minOffset);
+        KnownMaxOffset = std::max(KnownMaxOffset, maxOffset);
+    }
+
+    // Blocks may cover cells they never touch, so they're checked regardless of the guard regions.
+    void EmitBlockCheck(Int64 cells)
+    {
+        assert(cells > 0);
+
+        if (IsKnown(0, cells - 1))
+        {
+            return;
+        }
+
+        EmitRangeCheck(0, cells - 1);
+        KnownMaxOffset = std::max(KnownMaxOffset, cells - 1);
+    }
+
+    // Accesses within the guard regions fault on their own. The tape holds whole cells, so a cell reached by such a
+    // move lies entirely within the guard region.
+    Boolean IsChecked(Int64 minOffset, Int64 maxOffset) const noexcept
+    {
+        const auto guardCells = static_cast<Int64>(GuardSize) / Cell::Bytes;
+        return maxOffset > guardCells || -minOffset > guardCells;
+    }
+
+    void ForgetRange() noexcept
+    {
+        KnownMinOffset = 0;
+        KnownMaxOffset = 0;
+    }
+
+    // The room left is measured rather than the pointer moved, so that a huge distance can't wrap it around.
+    void EmitRangeCheck(Int64 minOffset, Int64 maxOffset)
+    {
+        assert(minOffset <= maxOffset);
+
+        if (maxOffset > 0)
+        {
+            Code.Move(Register::Rcx, EndRegister);
+            Code.Subtract(Register::Rcx, CurrentPtrRegister);
+            EmitCompareRoom(maxOffset * Cell::Bytes);
+            Code.JumpIf(Condition::BelowOrEqual, OutOfMemoryErrorLabel);
+        }
+
+        if (minOffset < 0)
+        {
+            Code.Move(Register::Rcx, CurrentPtrRegister);
+            Code.Subtract(Register::Rcx, BeginRegister);
+            EmitCompareRoom(-minOffset * Cell::Bytes);
+            Code.JumpIf(Condition::Below, MemoryUnderrunErrorLabel);
+        }
+    }
+
+    void EmitCompareRoom(Int64 bytes)
+    {
+        if (FitsInt32(bytes))
+        {
+            Code.ArithmeticWithImmediate(Arithmetic::Compare, Register::Rcx, static_cast<std::int32_t>(bytes));
+            return;
+        }
+
+        Code.MoveImmediate(Register::Rdx, bytes);
+        Code.Compare(Register::Rcx, Register::Rdx);
+    }
+
+    // Wraps `value` around the way the cell would, the operand being sign-extended from the cell width.
+    static Int64 Truncate(Int64 value) noexcept
+    {
+        return static_cast<std::make_signed_t<Value>>(static_cast<Value>(value));
+    }
+
+    static std::int32_t Displacement(Int64 offset)
+    {
+        const auto bytes = offset * Cell::Bytes;
+        if (!FitsInt32(bytes))
+        {
+            throw Exception::Formatted("cell offset {} is out of reach of the x64 backend", offset);
+        }
+
+        return static_cast<std::int32_t>(bytes);
+    }
+};
+
+// Holds the generated code, which is only made executable once it's been copied in.
+class ExecutableCode
+{
+public:
+    explicit ExecutableCode(const Vector<std::uint8_t> &code) : m_size(std::max<std::size_t>(code.size(), 1))
+    {
+        const auto mapping = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            throw Exception::Formatted("failed to map code: {}", std::strerror(errno));
+        }
+
+        m_mapping = mapping;
+        std::memcpy(m_mapping, code.data(), code.size());
+        if (mprotect(m_mapping, m_size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(m_mapping, m_size);
+            throw Exception::Formatted("failed to map code: {}", std::strerror(errno));
+        }
+    }
+
+    ExecutableCode(const ExecutableCode &) = delete;
+
+    ExecutableCode &operator=(const ExecutableCode &) = delete;
+
+    ~ExecutableCode()
+    {
+        munmap(m_mapping, m_size);
+    }
+
+    MainFunc Entry() const noexcept
+    {
+        return reinterpret_cast<MainFunc>(m_mapping);
+    }
+
+private:
+    void *m_mapping = nullptr;
+    std::size_t m_size = 0;
+};
+
+template <typename Cell> ir::Program BuildProgram(const CompilerContext &context)
+{
+    const Stopwatch stopwatch;
+    auto program = ir::BuildProgram(*context.Reader);
+    ir::Optimize<Cell>(program);
+    if (context.PrefixSteps)
+    {
+        ir::EvaluatePrefix<Cell>(program, context.PrefixSteps);
+    }
+    if (context.Statistics)
+    {
+        context.Statistics->BuildSeconds += stopwatch.ElapsedSeconds();
+    }
+
+    return program;
+}
+
+template <typename Cell> Entrypoint CompileProgram(const CompilerContext &context)
+{
+    auto program = BuildProgram<Cell>(context);
+    if (context.Profile)
+    {
+        context.Profile->Reset(program);
+    }
+
+    const Stopwatch emitStopwatch;
+    const auto operations = std::make_shared<const ir::Program>(std::move(program));
+    auto generator = CodeGenerator<Cell>{.GuardSize = context.GuardSize, .Profile = context.Profile};
+    const auto bytes = generator.Compile(*operations);
+    const auto code = std::make_shared<const ExecutableCode>(bytes);
+    if (context.Statistics)
+    {
+        context.Statistics->EmitSeconds += emitStopwatch.ElapsedSeconds();
+        context.Statistics->CodeBytes += bytes.size();
+    }
+
+    return [operations, code](CharPtr begin, CharPtr end, OutputBuffer *output, InputBuffer *input) {
+        return code->Entry()(begin, end, output, input);
+    };
+}
+
+template <typename Cell> RelocatableCode CompileRelocatableProgram(const CompilerContext &context)
+{
+    const auto program = BuildProgram<Cell>(context);
+
+    const Stopwatch emitStopwatch;
+    auto generator = CodeGenerator<Cell>{.GuardSize = context.GuardSize, .Relocatable = true};
+    auto code = RelocatableCode{.Code = generator.Compile(program)};
+    code.Data = std::move(generator.Data);
+    code.Relocations = generator.Code.Relocations();
+    if (context.Statistics)
+    {
+        context.Statistics->EmitSeconds += emitStopwatch.ElapsedSeconds();
+        context.Statistics->CodeBytes += code.Code.size();
+    }
+
+    return code;
+}
+} // namespace
+
+Boolean X64Compiler::IsSupported() noexcept
+{
+#if defined(__x86_64__) && defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+Entrypoint X64Compiler::Compile(const CompilerContext &context)
+{
+    if (!context.Reader)
+    {
+        throw Exception("instruction reader must not be null");
+    }
+
+    if (!IsSupported())
+    {
+        throw Exception("the x64 backend only runs on x86-64 Linux");
+    }
+
+    return DispatchCellBits(context.CellBits, [&](auto cell) { return CompileProgram<decltype(cell)>(context); });
+}
+
+RelocatableCode X64Compiler::CompileRelocatable(const CompilerContext &context)
+{
+    if (!context.Reader)
+    {
+        throw Exception("instruction reader must not be null");
+    }
+
+    if (context.Profile)
+    {
+        throw Exception("relocatable code can't be profiled");
+    }
+
+    return DispatchCellBits(context.CellBits,
+                            [&](auto cell) { return CompileRelocatableProgram<decltype(cell)>(context); });
+}
@@ -0,0 +1,43 @@
+#ifndef BFJIT_X64_COMPILER_HPP
+#define BFJIT_X64_COMPILER_HPP
+
+#include "types.hpp"
+
+namespace bfjit
+{
+// A reference from relocatable code to the function named `Symbol`, or to the data of the code when the name is empty,
+// which is left for the linker to resolve. `Type` is an x86-64 ELF relocation type applying at `Offset` in the code.
+struct CodeRelocation
+{
+    UInt64 Offset = 0;
+    UInt32 Type = 0;
+    String Symbol;
+    Int64 Addend = 0;
+};
+
+// Position independent code of a function following the `MainFunc` ABI, along with the data it refers to.
+struct RelocatableCode
+{
+    Vector<std::uint8_t> Code;
+    Vector<CharType> Data;
+    Vector<CodeRelocation> Relocations;
+};
+
+// Emits x86-64 machine code for the optimized program in a single pass, without an intermediate representation or
+// register allocation, which compiles programs in a fraction of the time MIR takes at the cost of peak throughput.
+class X64Compiler final : public CompilerBackend
+{
+public:
+    // Whether the host is able to run the code this backend generates.
+    static Boolean IsSupported() noexcept;
+
+    Entrypoint Compile(const CompilerContext &context) override;
+
+    // Compiles the program into code meant to be linked with a runtime defining `bfjit_write_output`, behaving like
+    // `WriteOutput`, and `bfjit_scan_forward_<bits>` and `bfjit_scan_backward_<bits>`, behaving like the scan kernels
+    // for cells of the given width. Profiling isn't supported.
+    static RelocatableCode CompileRelocatable(const CompilerContext &context);
+};
+} // namespace bfjit
+
+#endif // BFJIT_X64_COMPILER_HPP